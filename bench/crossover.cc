@@ -0,0 +1,84 @@
+#include <cstdio>
+#include <climits>
+
+#include "rng.hh"
+#include "sequential_sampler.hh"
+#include "options.hh"
+#include "timer.hh"
+
+/* Times methods A and D of the sequential sampler on their own over a range
+   of sampling fractions, to pick the ratio N/n below which method A takes
+   over (the ratio argument of math::basic_sequential_sampler) */
+
+//nanoseconds per position for n of N, with a crossover ratio that forces
+//one method: 0 never leaves method D, LONG_MAX never enters it
+template<class RNG>
+static double time_method(long n, long N, long ratio, int reps) {
+	double best = 0;
+	long check = 0;
+
+	for (int r = 0; r < reps; ++r) {
+		RNG rng(r + 1);
+		math::basic_sequential_sampler<RNG> samp(n, N, rng, ratio);
+
+		double start = bench::now();
+		for (long i = 0; i < n; ++i) {
+			check += samp.sample();
+		}
+		double t = (bench::now() - start) * 1e9 / n;
+
+		if (r == 0 or t < best) {
+			best = t;
+		}
+	}
+
+	//keep the positions alive
+	if (check == 42) {
+		std::printf("\n");
+	}
+
+	return best;
+}
+
+template<class RNG>
+static void run(const char* name, long N, int reps) {
+	static const long ratios[] = { 2, 3, 4, 6, 8, 10, 13, 16, 20, 25, 32, 50, 64, 100 };
+
+	std::printf("%s, N = %ld\n", name, N);
+	std::printf("%8s %12s %12s\n", "N/n", "A ns/pos", "D ns/pos");
+
+	long crossover = 0;
+	for (size_t k = 0; k < sizeof(ratios) / sizeof(ratios[0]); ++k) {
+		long n = N / ratios[k];
+		double a = time_method<RNG>(n, N, LONG_MAX, reps);
+		double d = time_method<RNG>(n, N, 0, reps);
+
+		std::printf("%8ld %12.1f %12.1f\n", ratios[k], a, d);
+
+		if (crossover == 0 and d < a) {
+			crossover = ratios[k];
+		}
+	}
+
+	if (crossover > 0) {
+		std::printf("method D is faster from N/n = %ld\n\n", crossover);
+	} else {
+		std::printf("method A is faster throughout\n\n");
+	}
+}
+
+int main(int argc, const char* argv[]) {
+
+	long N = 10000000;
+	int reps = 3;
+
+	misc::options::parser opts("crossover", "time methods A and D of the sequential sampler against each other", "");
+	opts.add_store_option('N', "max", "population size to sample from", N, "10000000", true);
+	opts.add_store_option('r', "reps", "repetitions, the fastest is reported", reps, "3", true);
+	opts.parse(argv, argv + argc);
+
+	run<math::random>("mt", N, reps);
+	run<math::xoshiro256pp>("xoshiro", N, reps);
+
+	return 0;
+}
@@ -0,0 +1,167 @@
+#include <cstdio>
+#include <climits>
+
+#include "rng.hh"
+#include "sequential_sampler.hh"
+#include "reservoir_sampler.hh"
+#include "bernoulli_sampler.hh"
+#include "options.hh"
+#include "timer.hh"
+
+/* Microbenchmarks: nanoseconds per draw of every random number generator,
+   per position of the sequential sampler's methods A and D over N up to
+   10^10 and n/N from 0.5 down to 10^-6, and per skip of the reservoir and
+   Bernoulli samplers. No I/O is involved; see throughput.cc for that. */
+
+//positions timed at most per sampler run
+static const long max_positions = 1 << 20;
+
+//method A walks every line: lines it may walk per run, and the N/n past
+//which it is not worth waiting for
+static const long method_a_lines = 1L << 28;
+static const long method_a_limit = 10000;
+
+//keeps the results alive
+static unsigned long long sink = 0;
+
+template<class RNG>
+static double time_int(long draws, int reps) {
+	double best = 0;
+	for (int r = 0; r < reps; ++r) {
+		RNG rng(r + 1);
+		double start = bench::now();
+		for (long i = 0; i < draws; ++i) {
+			sink += int(rng);
+		}
+		double t = (bench::now() - start) * 1e9 / draws;
+		if (r == 0 or t < best) {
+			best = t;
+		}
+	}
+	return best;
+}
+
+template<class RNG>
+static double time_double(long draws, int reps) {
+	double best = 0;
+	for (int r = 0; r < reps; ++r) {
+		RNG rng(r + 1);
+		double sum = 0;
+		double start = bench::now();
+		for (long i = 0; i < draws; ++i) {
+			sum += double(rng);
+		}
+		double t = (bench::now() - start) * 1e9 / draws;
+		sink += (unsigned long long) sum;
+		if (r == 0 or t < best) {
+			best = t;
+		}
+	}
+	return best;
+}
+
+//per position of the first k positions of n of N, with a crossover ratio
+//that forces one method: 0 never leaves method D, LONG_MAX never enters it
+template<class RNG>
+static double time_sequential(long n, long N, long k, long ratio, int reps) {
+	double best = 0;
+	for (int r = 0; r < reps; ++r) {
+		RNG rng(r + 1);
+		math::basic_sequential_sampler<RNG> samp(n, N, rng, ratio);
+		double start = bench::now();
+		for (long i = 0; i < k; ++i) {
+			sink += samp.sample();
+		}
+		double t = (bench::now() - start) * 1e9 / k;
+		if (r == 0 or t < best) {
+			best = t;
+		}
+	}
+	return best;
+}
+
+template<class RNG>
+static void rng_row(const char* name, long draws, int reps) {
+	std::printf("%-10s %12.2f %12.2f\n", name, time_int<RNG>(draws, reps), time_double<RNG>(draws, reps));
+}
+
+template<class RNG>
+static void sequential_rows(const char* name, int reps) {
+	static const long sizes[] = { 1000000L, 100000000L, 10000000000L };
+	static const double fractions[] = { 0.5, 1e-2, 1e-4, 1e-6 };
+
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+		long N = sizes[i];
+		if (N > (long(1) << RNG::bits)) {
+			continue;
+		}
+
+		for (size_t j = 0; j < sizeof(fractions) / sizeof(fractions[0]); ++j) {
+			long n = long(double(N) * fractions[j]);
+			if (n < 1) {
+				continue;
+			}
+
+			long k = (n < max_positions) ? n : max_positions;
+			long walk = method_a_lines / (N / n);
+
+			std::printf("%-10s %14ld %10g", name, N, fractions[j]);
+			if (N / n <= method_a_limit) {
+				std::printf(" %12.1f", time_sequential<RNG>(n, N, (k < walk) ? k : walk, LONG_MAX, reps));
+			} else {
+				std::printf(" %12s", "-");
+			}
+			std::printf(" %12.1f\n", time_sequential<RNG>(n, N, k, 0, reps));
+		}
+	}
+}
+
+int main(int argc, const char* argv[]) {
+
+	long draws = 10000000;
+	int reps = 3;
+
+	misc::options::parser opts("micro", "time the random number generators and samplers on their own", "");
+	opts.add_store_option('d', "draws", "random draws to time per generator", draws, "10000000", true);
+	opts.add_store_option('r', "reps", "repetitions, the fastest is reported", reps, "3", true);
+	opts.parse(argv, argv + argc);
+
+	std::printf("random number generators, ns per draw\n");
+	std::printf("%-10s %12s %12s\n", "rng", "int", "double");
+	rng_row<math::random>("mt", draws, reps);
+	rng_row<math::xoshiro256pp>("xoshiro", draws, reps);
+#ifdef __SIZEOF_INT128__
+	rng_row<math::pcg64>("pcg", draws, reps);
+#endif
+	rng_row<math::splitmix64>("splitmix", draws, reps);
+
+	std::printf("\nsequential sampler, ns per position (at most %ld positions timed)\n", max_positions);
+	std::printf("%-10s %14s %10s %12s %12s\n", "rng", "N", "n/N", "method A", "method D");
+	sequential_rows<math::random>("mt", reps);
+	sequential_rows<math::xoshiro256pp>("xoshiro", reps);
+
+	std::printf("\nstreaming samplers, ns per skip\n");
+	{
+		math::random rng(1);
+		math::reservoir_sampler res(1000, rng);
+		double start = bench::now();
+		for (long i = 0; i < draws; ++i) {
+			sink += res.skip() + res.slot();
+		}
+		std::printf("%-24s %12.2f\n", "reservoir (n = 1000)", (bench::now() - start) * 1e9 / draws);
+
+		math::bernoulli_sampler ber(1e-3, rng);
+		start = bench::now();
+		for (long i = 0; i < draws; ++i) {
+			sink += ber.skip();
+		}
+		std::printf("%-24s %12.2f\n", "bernoulli (p = 0.001)", (bench::now() - start) * 1e9 / draws);
+	}
+
+	//never true, but the compiler cannot know
+	if (sink == 42) {
+		std::printf("\n");
+	}
+
+	return 0;
+}
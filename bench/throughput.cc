@@ -0,0 +1,326 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <sstream>
+#include <iostream>
+
+#include <unistd.h>
+#include <zlib.h>
+
+#include "rng.hh"
+#include "options.hh"
+#include "timer.hh"
+
+/* End to end throughput of random-lines: writes synthetic inputs of short and
+   long lines to a scratch directory, plain, gzip and BGZF compressed, and
+   times the binary on each with every engine that applies (the sequential
+   sampler with and without a line index, threads, reservoir and Bernoulli
+   sampling) over a range of sampling fractions. The sample goes to
+   /dev/null, so this is input and sampling cost only. */
+
+//one line: its number, a tab, and letters up to len bytes with the newline
+static void make_line(std::string& line, long i, size_t len, const std::string& letters, math::xoshiro256pp& rng) {
+	char number[32];
+	int w = std::snprintf(number, sizeof(number), "%ld\t", i);
+
+	line.assign(number, w);
+	if (line.size() + 1 < len) {
+		size_t fill = len - line.size() - 1;
+		size_t at = size_t(long(rng) & 0x7fffffff) % (letters.size() - fill);
+		line.append(letters, at, fill);
+	}
+	line.push_back('\n');
+}
+
+static std::string letter_pool(math::xoshiro256pp& rng) {
+	std::string letters(1 << 16, 'a');
+	for (size_t i = 0; i < letters.size(); ++i) {
+		letters[i] = 'a' + (long(rng) & 0x7fffffff) % 26;
+	}
+	return letters;
+}
+
+static void write_all(FILE* f, const char* p, size_t len, const std::string& path) {
+	if (std::fwrite(p, 1, len, f) != len) {
+		throw std::runtime_error("cannot write " + path + ": " + std::strerror(errno));
+	}
+}
+
+//BGZF: gzip members of at most 64KB each, with the block size in a 'BC'
+//extra field, and an empty member to mark the end
+class bgzf_writer {
+public:
+	bgzf_writer(const std::string& path) : path(path), f(std::fopen(path.c_str(), "wb")) {
+		if (f == NULL) {
+			throw std::runtime_error("cannot open " + path + ": " + std::strerror(errno));
+		}
+		data.reserve(block_data);
+	}
+
+	~bgzf_writer() {
+		if (f != NULL) {
+			std::fclose(f);
+		}
+	}
+
+	void write(const char* p, size_t len) {
+		while (len > 0) {
+			size_t take = block_data - data.size();
+			if (take > len) {
+				take = len;
+			}
+			data.insert(data.end(), p, p + take);
+			p += take;
+			len -= take;
+
+			if (data.size() == block_data) {
+				flush();
+			}
+		}
+	}
+
+	void close() {
+		flush();
+		flush();
+		if (std::fclose(f) != 0) {
+			f = NULL;
+			throw std::runtime_error("cannot write " + path + ": " + std::strerror(errno));
+		}
+		f = NULL;
+	}
+
+private:
+	//uncompressed bytes to a block, leaving room for data that does not
+	//compress
+	static const size_t block_data = 0xff00;
+
+	//one member of what is buffered; an empty one is the end marker
+	void flush() {
+		z_stream zs;
+		std::memset(&zs, 0, sizeof(zs));
+		if (deflateInit2(&zs, 1, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+			throw std::runtime_error("cannot compress " + path);
+		}
+
+		unsigned char block[1 << 16];
+		const size_t header = 18;
+
+		zs.next_in = data.empty() ? NULL : (Bytef*) &data[0];
+		zs.avail_in = data.size();
+		zs.next_out = block + header;
+		zs.avail_out = sizeof(block) - header - 8;
+		int status = deflate(&zs, Z_FINISH);
+		size_t packed = zs.total_out;
+		deflateEnd(&zs);
+		if (status != Z_STREAM_END) {
+			throw std::runtime_error("cannot compress " + path);
+		}
+
+		size_t size = header + packed + 8;
+		unsigned char head[header] = { 0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 0xff, 6, 0, 'B', 'C', 2, 0,
+			(unsigned char) ((size - 1) & 0xff), (unsigned char) ((size - 1) >> 8) };
+		std::memcpy(block, head, header);
+
+		unsigned long crc = crc32(0L, Z_NULL, 0);
+		if (not data.empty()) {
+			crc = crc32(crc, (const Bytef*) &data[0], data.size());
+		}
+		unsigned long isize = data.size();
+		for (int i = 0; i < 4; ++i) {
+			block[header + packed + i] = (crc >> (8 * i)) & 0xff;
+			block[header + packed + 4 + i] = (isize >> (8 * i)) & 0xff;
+		}
+
+		write_all(f, (const char*) block, size, path);
+		data.clear();
+	}
+
+	std::string path;
+	FILE* f;
+	std::vector<char> data;
+};
+
+struct input {
+	std::string name, path;
+	long lines;
+	size_t bytes;
+	bool compressed;
+};
+
+//the same lines three ways: plain, gzip and BGZF
+static void write_inputs(const std::string& dir, const std::string& name, long lines, size_t len, std::vector<input>& inputs) {
+	math::xoshiro256pp rng(len);
+	std::string letters = letter_pool(rng);
+
+	std::string plain = dir + "/" + name + ".txt";
+	std::string gz = plain + ".gz";
+	std::string bgz = plain + ".bgz";
+
+	FILE* f = std::fopen(plain.c_str(), "wb");
+	gzFile g = gzopen(gz.c_str(), "wb1");
+	if (f == NULL or g == NULL) {
+		throw std::runtime_error("cannot write to " + dir + ": " + std::strerror(errno));
+	}
+	bgzf_writer b(bgz);
+
+	std::string line;
+	size_t bytes = 0;
+	for (long i = 0; i < lines; ++i) {
+		make_line(line, i, len, letters, rng);
+		write_all(f, line.data(), line.size(), plain);
+		if (gzwrite(g, line.data(), line.size()) != int(line.size())) {
+			throw std::runtime_error("cannot write " + gz);
+		}
+		b.write(line.data(), line.size());
+		bytes += line.size();
+	}
+
+	if (std::fclose(f) != 0 or gzclose(g) != Z_OK) {
+		throw std::runtime_error("cannot write to " + dir + ": " + std::strerror(errno));
+	}
+	b.close();
+
+	input in = { name + ".txt", plain, lines, bytes, false };
+	inputs.push_back(in);
+	in.name = name + ".txt.gz";
+	in.path = gz;
+	in.compressed = true;
+	inputs.push_back(in);
+	in.name = name + ".txt.bgz";
+	in.path = bgz;
+	inputs.push_back(in);
+}
+
+//runs the command, seconds it took
+static double run(const std::string& command) {
+	double start = bench::now();
+	if (std::system(command.c_str()) != 0) {
+		throw std::runtime_error("failed: " + command);
+	}
+	return bench::now() - start;
+}
+
+//fastest of reps runs of random-lines with these arguments on the input
+static void time_engine(const std::string& binary, const input& in, const std::string& engine, const std::string& args, int reps) {
+	std::string command = binary + " " + args + " -i" + in.path + " > /dev/null";
+
+	double best = 0;
+	for (int r = 0; r < reps; ++r) {
+		double t = run(command);
+		if (r == 0 or t < best) {
+			best = t;
+		}
+	}
+
+	std::printf("%-16s %-10s %-28s %10.3f %10.2f %12.1f\n", in.name.c_str(), engine.c_str(), args.c_str(),
+		best, in.bytes / best / 1e9, in.lines / best / 1e6);
+	std::fflush(stdout);
+}
+
+static std::string arg(const char* option, long value) {
+	std::ostringstream out;
+	out << option << value;
+	return out.str();
+}
+
+static std::string arg(const char* option, double value) {
+	std::ostringstream out;
+	out << option << value;
+	return out.str();
+}
+
+int main(int argc, const char* argv[]) {
+
+	std::string binary = "src/random-lines";
+	std::string indexer = "src/random-lines-index";
+	std::string tmp = "/tmp";
+	long max = 10000000;
+	size_t max_bytes = size_t(1) << 30;
+	int threads = 4;
+	int reps = 1;
+
+	misc::options::parser opts("throughput", "time random-lines end to end on synthetic inputs", "");
+	opts.add_store_option('b', "binary", "random-lines binary to time", binary, "src/random-lines", true);
+	opts.add_store_option('x', "indexer", "random-lines-index binary to build the line indexes with", indexer, "src/random-lines-index", true);
+	opts.add_store_option('d', "dir", "write the inputs to a scratch directory under DIR", tmp, "/tmp", true);
+	opts.add_store_option('N', "max", "lines in each input, fewer if over --bytes", max, "10000000", true);
+	opts.add_store_option(0, "bytes", "bytes in each uncompressed input at most", max_bytes, "1073741824", true);
+	opts.add_store_option('t', "threads", "threads for the threaded engine", threads, "4", true);
+	opts.add_store_option('r', "reps", "repetitions, the fastest is reported", reps, "1", true);
+	opts.parse(argv, argv + argc);
+
+	static const double fractions[] = { 0.5, 1e-2, 1e-4 };
+	static const size_t lengths[] = { 20, 200 };
+	static const char* names[] = { "short", "long" };
+
+	std::string dir = tmp + "/random-lines-bench.XXXXXX";
+	if (::mkdtemp(&dir[0]) == NULL) {
+		std::cerr << "ERROR: cannot create a directory under " << tmp << ": " << std::strerror(errno) << std::endl;
+		return 1;
+	}
+
+	std::vector<input> inputs;
+	int status = 0;
+
+	try {
+
+		for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); ++i) {
+			long lines = max;
+			if (size_t(lines) * lengths[i] > max_bytes) {
+				lines = max_bytes / lengths[i];
+			}
+			write_inputs(dir, names[i], lines, lengths[i], inputs);
+		}
+
+		std::printf("%-16s %-10s %-28s %10s %10s %12s\n", "input", "engine", "arguments", "seconds", "GB/s", "Mlines/s");
+
+		for (size_t i = 0; i < inputs.size(); ++i) {
+			const input& in = inputs[i];
+
+			for (size_t j = 0; j < sizeof(fractions) / sizeof(fractions[0]); ++j) {
+				long n = long(in.lines * fractions[j]);
+				if (n < 1) {
+					continue;
+				}
+				std::string sized = arg("-n", n) + arg(" -N", in.lines);
+
+				time_engine(binary, in, "sequential", sized, reps);
+				if (not in.compressed) {
+					time_engine(binary, in, "threads", sized + arg(" -t", long(threads)), reps);
+				}
+				time_engine(binary, in, "reservoir", arg("-r -n", n), reps);
+				time_engine(binary, in, "bernoulli", arg("-p", fractions[j]), reps);
+			}
+
+			//the index is only read for plain and BGZF inputs
+			if (in.compressed and in.name.find(".bgz") == std::string::npos) {
+				continue;
+			}
+			run(indexer + " " + in.path);
+			for (size_t j = 0; j < sizeof(fractions) / sizeof(fractions[0]); ++j) {
+				long n = long(in.lines * fractions[j]);
+				if (n < 1) {
+					continue;
+				}
+				time_engine(binary, in, "indexed", arg("-n", n) + arg(" -N", in.lines), reps);
+			}
+			std::remove((in.path + ".rli").c_str());
+		}
+
+	} catch (std::exception& e) {
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		status = 1;
+	}
+
+	for (size_t i = 0; i < inputs.size(); ++i) {
+		std::remove(inputs[i].path.c_str());
+		std::remove((inputs[i].path + ".rli").c_str());
+	}
+	::rmdir(dir.c_str());
+
+	return status;
+}
@@ -0,0 +1,17 @@
+#ifndef _BENCH_TIMER_HH_
+#define _BENCH_TIMER_HH_
+
+#include <time.h>
+
+namespace bench {
+
+//seconds on a monotonic clock
+inline double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+}
+
+#endif
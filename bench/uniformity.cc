@@ -0,0 +1,291 @@
+#include <cstdio>
+#include <cmath>
+#include <climits>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+
+#include "rng.hh"
+#include "sequential_sampler.hh"
+#include "functions.hh"
+#include "options.hh"
+#include "timer.hh"
+
+/* Statistical check of the sequential sampler and the generators under it,
+   to be passed before a faster variant of either replaces the current one.
+
+   Every regime draws n of N many times over: n = 1, method A, method D, N
+   just below, at and just above the crossover ratio times n, and N beyond
+   the 32 bits of the Mersenne Twister. Two chi-square tests are run on what
+   comes out: how often each position is drawn, in up to 100 bins of
+   neighbouring positions, and where the first drawn position falls, in
+   bins of equal probability; the first position alone is enough to show a
+   skew in the skips method D draws by rejection. Positions must also come
+   out strictly increasing within 1..N. The generators are checked on their
+   own, doubles in 100 bins and the low 7 bits of integers.
+
+   p-values come from math::upper_incomplete_gamma and a regime fails below
+   --alpha. Sampling is timed apart from the counting, in ns per position.
+   The exit status is 1 if anything failed. */
+
+//p-value of a chi-square statistic
+static double chi2_p(double stat, int df) {
+	if (stat <= 0) {
+		return 1;
+	}
+	return math::upper_incomplete_gamma(0.5 * df, 0.5 * stat);
+}
+
+//P(first drawn position > j) for n of N
+static double first_after(long j, long n, long N) {
+	double log_s = 0;
+	for (long t = 0; t < n; ++t) {
+		if (j >= N - t) {
+			return 0;
+		}
+		log_s += std::log1p(-double(j) / double(N - t));
+	}
+	return std::exp(log_s);
+}
+
+//bin edges for the first position, of about equal probability: bin k holds
+//edges[k] < position <= edges[k + 1]
+static void first_edges(long n, long N, int bins, std::vector<long>& edges) {
+	long last = N - n + 1;
+
+	edges.assign(1, 0);
+	for (int k = 1; k < bins; ++k) {
+		double target = 1.0 - double(k) / bins;
+
+		//smallest j with P(first > j) at or below target
+		long lo = edges.back(), hi = last;
+		while (lo < hi) {
+			long mid = lo + (hi - lo) / 2;
+			if (first_after(mid, n, N) <= target) {
+				hi = mid;
+			} else {
+				lo = mid + 1;
+			}
+		}
+		if (lo > edges.back() and lo < last) {
+			edges.push_back(lo);
+		}
+	}
+	edges.push_back(last);
+}
+
+struct outcome {
+	double ns, inclusion_p, first_p;
+	bool ordered;
+};
+
+//trials of n of N, with positions counted into bins and the first one
+//placed among the edges
+template<class RNG>
+static outcome run_regime(long n, long N, long ratio, long draws, unsigned long seed) {
+	long trials = draws / n;
+	if (trials < 2000) {
+		trials = 2000;
+	}
+
+	long bins = (N < 100) ? N : 100;
+	std::vector<double> counts(bins, 0);
+
+	std::vector<long> edges;
+	first_edges(n, N, (trials / 100 < 50) ? int(trials / 100) : 50, edges);
+	std::vector<double> firsts(edges.size() - 1, 0);
+
+	std::vector<long> positions(n);
+	outcome out = { 0, 0, 0, true };
+	double elapsed = 0;
+
+	RNG rng(seed);
+	for (long t = 0; t < trials; ++t) {
+		math::basic_sequential_sampler<RNG> samp(n, N, rng, ratio);
+
+		double start = bench::now();
+		size_t got = samp.fill(&positions[0], n);
+		elapsed += bench::now() - start;
+
+		if (long(got) != n) {
+			out.ordered = false;
+		}
+		for (long i = 0; i < n; ++i) {
+			long p = positions[i];
+			if (p < 1 or p > N or (i > 0 and p <= positions[i - 1])) {
+				out.ordered = false;
+				break;
+			}
+			counts[(p - 1) / ((N + bins - 1) / bins)] += 1;
+		}
+
+		size_t k = std::upper_bound(edges.begin(), edges.end(), positions[0] - 1) - edges.begin() - 1;
+		if (k < firsts.size()) {
+			firsts[k] += 1;
+		}
+	}
+	out.ns = elapsed * 1e9 / (double(trials) * n);
+
+	//bin b holds positions b * width + 1 .. (b + 1) * width, the last one
+	//what is left; draws without replacement vary less than independent ones
+	//by (N - n) / (N - 1)
+	long width = (N + bins - 1) / bins;
+	double rate = double(trials) * n / N;
+	double stat = 0;
+	int df = -1;
+	for (long b = 0; b < bins; ++b) {
+		long size = std::min(width, N - b * width);
+		if (size <= 0) {
+			continue;
+		}
+		double expected = rate * size;
+		stat += (counts[b] - expected) * (counts[b] - expected) / expected;
+		++df;
+	}
+	if (n < N and df > 0) {
+		out.inclusion_p = chi2_p(stat * (N - 1) / (N - n), df);
+	} else {
+		out.inclusion_p = 1;
+	}
+
+	stat = 0;
+	df = int(firsts.size()) - 1;
+	for (size_t k = 0; k < firsts.size(); ++k) {
+		double expected = trials * (first_after(edges[k], n, N) - first_after(edges[k + 1], n, N));
+		stat += (firsts[k] - expected) * (firsts[k] - expected) / expected;
+	}
+	out.first_p = (df > 0) ? chi2_p(stat, df) : 1;
+
+	return out;
+}
+
+struct regime {
+	const char* name;
+	long n, N;
+
+	//crossover ratio; -1 for the generator's default
+	long ratio;
+};
+
+template<class RNG>
+static int run_regimes(const char* rng_name, const regime* regimes, size_t count, long draws, unsigned long seed, double alpha) {
+	int failed = 0;
+	for (size_t i = 0; i < count; ++i) {
+		const regime& r = regimes[i];
+		long ratio = (r.ratio < 0) ? math::default_crossover<RNG>::ratio : r.ratio;
+
+		outcome out = run_regime<RNG>(r.n, r.N, ratio, draws, seed + i);
+		bool pass = out.ordered and out.inclusion_p >= alpha and out.first_p >= alpha;
+		if (not pass) {
+			++failed;
+		}
+
+		std::printf("%-9s %-14s %8ld %12ld %8.1f %12.4f %12.4f  %s\n", rng_name, r.name, r.n, r.N,
+			out.ns, out.inclusion_p, out.first_p, pass ? "ok" : (out.ordered ? "FAIL" : "FAIL (order)"));
+		std::fflush(stdout);
+	}
+	return failed;
+}
+
+//doubles in 100 bins, the low 7 bits of integers in 128
+template<class RNG>
+static int check_rng(const char* name, long draws, unsigned long seed, double alpha) {
+	RNG rng(seed);
+	std::vector<double> doubles(100, 0), low(128, 0);
+
+	for (long i = 0; i < draws; ++i) {
+		double u = double(rng);
+		int b = int(u * 100);
+		doubles[(b < 100) ? b : 99] += 1;
+		low[(unsigned long)(rng) & 127] += 1;
+	}
+
+	double stat_d = 0, stat_l = 0;
+	for (size_t b = 0; b < doubles.size(); ++b) {
+		double expected = draws / 100.0;
+		stat_d += (doubles[b] - expected) * (doubles[b] - expected) / expected;
+	}
+	for (size_t b = 0; b < low.size(); ++b) {
+		double expected = draws / 128.0;
+		stat_l += (low[b] - expected) * (low[b] - expected) / expected;
+	}
+
+	double p_d = chi2_p(stat_d, 99), p_l = chi2_p(stat_l, 127);
+	bool pass = p_d >= alpha and p_l >= alpha;
+	std::printf("%-9s %12.4f %12.4f  %s\n", name, p_d, p_l, pass ? "ok" : "FAIL");
+	std::fflush(stdout);
+	return pass ? 0 : 1;
+}
+
+int main(int argc, const char* argv[]) {
+
+	long draws = 2000000;
+	unsigned long seed = 1;
+	double alpha = 1e-4;
+
+	misc::options::parser opts("uniformity", "chi-square checks of the sequential sampler and the random number generators", "");
+	opts.add_store_option('d', "draws", "positions to draw per regime", draws, "2000000", true);
+	opts.add_store_option('s', "seed", "seed for the first regime, the next ones count up from it", seed, "1", true);
+	opts.add_store_option('a', "alpha", "p-value below which a check fails", alpha, "0.0001", true);
+	opts.parse(argv, argv + argc);
+
+	//the crossover regimes are around 13n for the Mersenne Twister and 20n
+	//for the others (see default_crossover)
+	static const regime mt_regimes[] = {
+		{ "n = 1", 1, 1000, -1 },
+		{ "method A", 500, 1000, -1 },
+		{ "method D", 10, 100000, -1 },
+		{ "forced A", 50, 5000, LONG_MAX },
+		{ "forced D", 50, 5000, 0 },
+		{ "below 13n", 100, 1299, -1 },
+		{ "at 13n", 100, 1300, -1 },
+		{ "above 13n", 100, 1301, -1 },
+		{ "N = 4e9", 1000, 4000000000L, -1 }
+	};
+	static const regime regimes[] = {
+		{ "n = 1", 1, 1000, -1 },
+		{ "method A", 500, 1000, -1 },
+		{ "method D", 10, 100000, -1 },
+		{ "forced A", 50, 5000, LONG_MAX },
+		{ "forced D", 50, 5000, 0 },
+		{ "below 20n", 100, 1999, -1 },
+		{ "at 20n", 100, 2000, -1 },
+		{ "above 20n", 100, 2001, -1 },
+		{ "N = 1e10", 1000, 10000000000L, -1 }
+	};
+	static const size_t mt_count = sizeof(mt_regimes) / sizeof(mt_regimes[0]);
+	static const size_t count = sizeof(regimes) / sizeof(regimes[0]);
+
+	int failed = 0;
+
+	try {
+
+		std::printf("generators, p-values\n");
+		std::printf("%-9s %12s %12s\n", "rng", "doubles", "low bits");
+		failed += check_rng<math::random>("mt", draws * 5, seed, alpha);
+		failed += check_rng<math::xoshiro256pp>("xoshiro", draws * 5, seed, alpha);
+#ifdef __SIZEOF_INT128__
+		failed += check_rng<math::pcg64>("pcg", draws * 5, seed, alpha);
+#endif
+		failed += check_rng<math::splitmix64>("splitmix", draws * 5, seed, alpha);
+
+		std::printf("\nsequential sampler, p-values\n");
+		std::printf("%-9s %-14s %8s %12s %8s %12s %12s\n", "rng", "regime", "n", "N", "ns/pos", "inclusion", "first");
+		failed += run_regimes<math::random>("mt", mt_regimes, mt_count, draws, seed, alpha);
+		failed += run_regimes<math::xoshiro256pp>("xoshiro", regimes, count, draws, seed, alpha);
+#ifdef __SIZEOF_INT128__
+		failed += run_regimes<math::pcg64>("pcg", regimes, count, draws, seed, alpha);
+#endif
+		failed += run_regimes<math::splitmix64>("splitmix", regimes, count, draws, seed, alpha);
+
+	} catch (std::exception& e) {
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+
+	if (failed > 0) {
+		std::printf("\n%d check(s) failed\n", failed);
+		return 1;
+	}
+	return 0;
+}
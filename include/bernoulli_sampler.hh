@@ -0,0 +1,42 @@
+#ifndef _BERNOULLI_SAMPLER_H_
+#define _BERNOULLI_SAMPLER_H_
+
+#include <cmath>
+#include <climits>
+
+#include "rng.hh"
+
+namespace math {
+
+/* Bernoulli sampling: every item is kept on its own with probability p
+
+   Instead of a draw per item, skip() says how many items to pass over
+   before the next one kept. The gaps are geometric, floor(log U / log(1-p)),
+   so there is one draw per kept item and the number of items need not be
+   known. */
+
+template<class RNG>
+class basic_bernoulli_sampler {
+public:
+	basic_bernoulli_sampler(double p, RNG& rng)
+	: rng(rng), scale(1.0 / std::log1p(-p)) {
+	}
+
+	//items to pass over before the next one kept
+	long skip() {
+		double x = std::floor(std::log(open_uniform(rng)) * scale);
+		return (x < double(LONG_MAX)) ? long(x) : LONG_MAX;
+	}
+
+private:
+	RNG& rng;
+
+	//1 / log(1 - p), for p in (0, 1]; -0 for p = 1, which keeps everything
+	double scale;
+};
+
+typedef basic_bernoulli_sampler<math::random> bernoulli_sampler;
+
+}
+
+#endif
@@ -0,0 +1,405 @@
+#ifndef _BGZF_HH_
+#define _BGZF_HH_
+
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <stdexcept>
+
+#include <zlib.h>
+#include <omp.h>
+#include <pthread.h>
+
+#include "source.hh"
+#include "newline.hh"
+#include "line_index.hh"
+
+/* BGZF (blocked gzip, as used by BAM and tabix) decompression
+
+   A BGZF file is a series of gzip members of at most 64 KiB each, whose
+   header records the compressed size of the member. Blocks can therefore be
+   cut out of the stream without inflating them, and inflated independently.
+   bgzf_source reads a window of blocks, inflates them on all OpenMP threads
+   and hands the output back in order. While a window is handed out, the next
+   one is read and inflated on a thread of its own, so the line scanner and
+   the inflaters overlap; two windows are held at a time.
+
+   Given a line_index it can also jump straight to the block holding a line;
+   the window then starts at one block and doubles with every window read in
+   sequence, so sparse jumps inflate little more than the blocks they hit. */
+
+namespace misc { namespace io {
+
+static const size_t bgzf_header_size = 18;
+static const size_t bgzf_max_block = 1 << 16;
+
+//true if the bytes start a BGZF block
+inline bool is_bgzf(const char* p, size_t len) {
+	const unsigned char* u = (const unsigned char*) p;
+	return is_gzip(p, len) and len >= bgzf_header_size
+		and (u[3] & 4) and u[12] == 'B' and u[13] == 'C' and u[14] == 2 and u[15] == 0;
+}
+
+//total size of the block whose header is at p
+inline size_t bgzf_block_size(const char* p) {
+	const unsigned char* u = (const unsigned char*) p;
+	return size_t(u[16] | (u[17] << 8)) + 1;
+}
+
+//uncompressed size recorded at the end of a whole block
+inline size_t bgzf_inflated_size(const char* p, size_t size) {
+	const unsigned char* u = (const unsigned char*) p + size - 4;
+	return size_t(u[0]) | (size_t(u[1]) << 8) | (size_t(u[2]) << 16) | (size_t(u[3]) << 24);
+}
+
+//read one whole block from in; false at the end of the input
+inline bool bgzf_read_block(source& in, std::vector<char>& block) {
+	block.resize(bgzf_header_size);
+
+	size_t got = 0;
+	while (got < bgzf_header_size) {
+		size_t r = in.read(&block[got], bgzf_header_size - got);
+		if (r == 0) break;
+		got += r;
+	}
+
+	if (got == 0) {
+		return false;
+	}
+	if (got < bgzf_header_size or not is_bgzf(&block[0], got)) {
+		throw std::runtime_error("corrupt BGZF input");
+	}
+
+	size_t size = bgzf_block_size(&block[0]);
+	if (size < bgzf_header_size + 8) {
+		throw std::runtime_error("corrupt BGZF input");
+	}
+	block.resize(size);
+
+	while (got < size) {
+		size_t r = in.read(&block[got], size - got);
+		if (r == 0) {
+			throw std::runtime_error("truncated BGZF input");
+		}
+		got += r;
+	}
+
+	return true;
+}
+
+//inflate a whole block into out (room for bgzf_max_block bytes) with a raw
+//inflate stream; returns the inflated size or -1 on corrupt data
+inline long bgzf_inflate_block(z_stream& zs, const char* block, size_t size, char* out) {
+	size_t isize = bgzf_inflated_size(block, size);
+	if (isize > bgzf_max_block) {
+		return -1;
+	}
+
+	inflateReset(&zs);
+	zs.next_in = (Bytef*) block + bgzf_header_size;
+	zs.avail_in = size - bgzf_header_size - 8;
+	zs.next_out = (Bytef*) out;
+	zs.avail_out = bgzf_max_block;
+
+	if (inflate(&zs, Z_FINISH) != Z_STREAM_END or zs.total_out != isize) {
+		return -1;
+	}
+
+	return long(isize);
+}
+
+//index the BGZF file open on fd, inflating on all OpenMP threads
+inline void bgzf_build_index(int fd, line_index& index, size_t window = 1024) {
+	index.reset(line_index::bgzf_blocks, fd);
+
+	fd_source in(fd);
+	in.seek(0);
+
+	std::vector<std::vector<char> > compressed(window);
+	std::vector<size_t> counts(window), sizes(window);
+	std::vector<char> last(window);
+
+	uint64_t offset = 0, total = 0;
+	bool done = false, corrupt = false;
+	char tail = '\n';
+
+	while (not done) {
+		size_t count = 0;
+		while (count < window and bgzf_read_block(in, compressed[count])) {
+			++count;
+		}
+		done = (count < window);
+
+		#pragma omp parallel
+		{
+			z_stream zs;
+			std::memset(&zs, 0, sizeof(zs));
+			inflateInit2(&zs, -15);
+			std::vector<char> out(bgzf_max_block);
+
+			#pragma omp for schedule(dynamic, 8)
+			for (long i = 0; i < long(count); ++i) {
+				long r = bgzf_inflate_block(zs, &compressed[i][0], compressed[i].size(), &out[0]);
+				if (r < 0) {
+					#pragma omp atomic write
+					corrupt = true;
+					r = 0;
+				}
+				counts[i] = count_newlines(&out[0], &out[0] + r);
+				sizes[i] = r;
+				last[i] = r ? out[r - 1] : 0;
+			}
+
+			inflateEnd(&zs);
+		}
+
+		if (corrupt) {
+			throw std::runtime_error("corrupt BGZF input");
+		}
+
+		for (size_t i = 0; i < count; ++i) {
+			//empty blocks (the end-of-file marker) hold nothing to find
+			if (sizes[i] > 0) {
+				index.add_block(offset, total);
+				total += counts[i];
+				tail = last[i];
+			}
+			offset += compressed[i].size();
+		}
+	}
+
+	index.set_lines(total + (tail != '\n'));
+}
+
+class bgzf_source : public source {
+public:
+	bgzf_source(fd_source& in, const line_index* index = NULL, size_t window = 256)
+	: in(in), index(index), max_window(window), window(window), done(false), threads(1), fetching(false), running(false), in_sequence(true), current(0), offset(0), position(0) {
+	}
+
+	~bgzf_source() {
+		join();
+	}
+
+	//hands out what is left of the current window, reading the next one if
+	//the current one is used up
+	size_t read(char* out, size_t len) {
+		size_t got = 0;
+
+		while (got < len) {
+			if (current == blocks.size() and (got > 0 or not load())) {
+				break;
+			}
+
+			block& b = blocks[current];
+			size_t r = std::min(len - got, b.length - offset);
+			std::memcpy(out + got, &b.inflated[offset], r);
+
+			got += r;
+			offset += r;
+
+			if (offset == b.length) {
+				++current;
+				offset = 0;
+			}
+		}
+
+		return got;
+	}
+
+	bool jump(size_t target, size_t& lines) {
+		if (index == NULL or index->num_blocks() == 0) {
+			return false;
+		}
+
+		const line_index::block& b = (*index)[index->find_block(target)];
+
+		//the window being inflated ahead has read up to position already
+		bool ahead = fetching;
+		wait();
+
+		//only forward, past whatever has been read already; a window
+		//inflated ahead is still handed out next
+		if (b.offset <= position) {
+			fetching = ahead;
+			return false;
+		}
+
+		in.seek(b.offset);
+		position = b.offset;
+
+		blocks.clear();
+		next.clear();
+		current = offset = 0;
+		done = false;
+		window = 1;
+		in_sequence = false;
+
+		lines = b.lines;
+		return true;
+	}
+
+private:
+	bgzf_source(const bgzf_source&);
+	bgzf_source& operator=(const bgzf_source&);
+
+	struct block {
+		std::vector<char> compressed, inflated;
+		size_t length;
+	};
+
+	//the next window of blocks, inflated ahead while the current one is
+	//scanned if there is one in the works
+	bool load() {
+		bool ahead = fetching;
+		if (ahead) {
+			wait();
+		} else if (done) {
+			return false;
+		}
+
+		//as many inflaters as the reading thread may start itself; set while
+		//no fetcher runs
+		threads = omp_get_max_threads();
+
+		if (ahead) {
+			blocks.swap(next);
+		} else {
+			fetch(blocks);
+			if (not error.empty()) {
+				throw_error();
+			}
+		}
+
+		//not right after a jump, which is more likely than not followed by
+		//another one
+		if (not done and in_sequence) {
+			start();
+		}
+		in_sequence = true;
+
+		current = 0;
+		offset = 0;
+
+		//skip empty blocks, such as the end-of-file marker
+		while (current < blocks.size() and blocks[current].length == 0) {
+			++current;
+		}
+
+		return current < blocks.size() or load();
+	}
+
+	//read a window of blocks into into and inflate them in parallel; what
+	//went wrong goes to error
+	void fetch(std::vector<block>& into) {
+		try {
+			into.resize(window);
+			size_t count = 0;
+			while (count < window and bgzf_read_block(in, into[count].compressed)) {
+				position += into[count].compressed.size();
+				++count;
+			}
+			if (count < window) {
+				done = true;
+			}
+			into.resize(count);
+			window = std::min(2 * window, max_window);
+		} catch (std::exception& e) {
+			into.clear();
+			done = true;
+			error = e.what();
+			return;
+		}
+
+		bool corrupt = false;
+
+		#pragma omp parallel num_threads(threads)
+		{
+			z_stream zs;
+			std::memset(&zs, 0, sizeof(zs));
+			inflateInit2(&zs, -15);
+
+			#pragma omp for schedule(dynamic, 8)
+			for (long i = 0; i < long(into.size()); ++i) {
+				block& b = into[i];
+				b.inflated.resize(bgzf_max_block);
+
+				long r = bgzf_inflate_block(zs, &b.compressed[0], b.compressed.size(), &b.inflated[0]);
+				if (r < 0) {
+					#pragma omp atomic write
+					corrupt = true;
+					r = 0;
+				}
+				b.length = r;
+			}
+
+			inflateEnd(&zs);
+		}
+
+		if (corrupt) {
+			error = "corrupt BGZF input";
+		}
+	}
+
+	static void* run(void* self) {
+		bgzf_source* s = (bgzf_source*) self;
+		s->fetch(s->next);
+		return NULL;
+	}
+
+	//inflate the next window on a thread of its own
+	void start() {
+		if (pthread_create(&fetcher, NULL, run, this) != 0) {
+			fetch(next);
+		} else {
+			running = true;
+		}
+		fetching = true;
+	}
+
+	//until the window being inflated is done; the thread's data is ours again
+	void join() {
+		if (fetching and running) {
+			pthread_join(fetcher, NULL);
+			running = false;
+		}
+	}
+
+	void wait() {
+		join();
+		fetching = false;
+		if (not error.empty()) {
+			throw_error();
+		}
+	}
+
+	void throw_error() {
+		std::string what;
+		what.swap(error);
+		throw std::runtime_error(what);
+	}
+
+	fd_source& in;
+	const line_index* index;
+
+	size_t max_window, window;
+	bool done;
+	int threads;
+
+	//the window being handed out and the one inflated ahead of it; the
+	//fetcher owns next, in, position, window and done while it runs
+	std::vector<block> blocks, next;
+	pthread_t fetcher;
+	bool fetching, running, in_sequence;
+	std::string error;
+
+	size_t current, offset;
+
+	//offset in the compressed file of the next block to read
+	uint64_t position;
+};
+
+} }
+
+#endif
@@ -166,7 +166,7 @@ namespace math {
 		h = d;
 		
 		for(unsigned int i = 1; i < 100; ++i) {
-			an = -i * (i - a);
+			an = -double(i) * (i - a);
 			b += 2;
 			d = an * d + b;
 			if(std::fabs(d) < 1e-30) 
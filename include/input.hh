@@ -0,0 +1,176 @@
+#ifndef _INPUT_HH_
+#define _INPUT_HH_
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "source.hh"
+#include "bgzf.hh"
+#include "line_index.hh"
+#include "mapped_file.hh"
+#include "line_reader.hh"
+
+/* Input selection: gzip and BGZF are decompressed on the fly, other
+   regular files are mapped and everything else is streamed. A BGZF or text
+   file with a sidecar index (see line_index.hh) is read only where needed. */
+
+namespace misc { namespace io {
+
+class input {
+public:
+	enum format { plain, gzip, bgzf };
+
+	//empty path or "-" reads STDIN
+	input(const std::string& path)
+	: fd(-1), owned(false), kind(plain), map(NULL), raw(NULL), src(NULL), lines(NULL) {
+
+		if (path.empty() or path == "-") {
+			fd = STDIN_FILENO;
+		} else {
+			fd = ::open(path.c_str(), O_RDONLY);
+			if (fd < 0) {
+				throw std::runtime_error("cannot open " + path + ": " + std::strerror(errno));
+			}
+			owned = true;
+		}
+
+		raw = new fd_source(fd);
+
+		char magic[bgzf_header_size];
+		size_t got = raw->peek(magic, sizeof(magic));
+
+		if (is_bgzf(magic, got)) {
+			kind = bgzf;
+			if (owned) {
+				index.load(line_index::sidecar(path), fd);
+			}
+		} else if (is_gzip(magic, got)) {
+			kind = gzip;
+		} else if (mapped_file::mappable(fd) and ::lseek(fd, 0, SEEK_CUR) == 0) {
+			//STDIN only if nobody has read from it yet
+			map = new mapped_file(fd);
+
+			//with an index only the sampled lines are touched
+			if (owned and index.load(line_index::sidecar(path), fd)) {
+				map->random_access(0, map->size());
+			}
+		}
+
+		if (indexed() and index.type() != (map ? line_index::text_lines : line_index::bgzf_blocks)) {
+			throw std::runtime_error("index " + line_index::sidecar(path) + " does not match the input");
+		}
+	}
+
+	~input() {
+		delete lines;
+		if (src != raw) {
+			delete src;
+		}
+		delete raw;
+		delete map;
+		if (owned) {
+			::close(fd);
+		}
+	}
+
+	format compression() const { return kind; }
+
+	line_reader& reader() {
+		if (lines == NULL) {
+			if (map != NULL) {
+				lines = new line_reader(*map, indexed() ? &index : NULL);
+			} else {
+				src = decompressor(*raw);
+				lines = new line_reader(*src);
+			}
+		}
+		return *lines;
+	}
+
+	//true if a sidecar index was found
+	bool indexed() const { return index.type() != line_index::none; }
+
+	//total number of lines, counted on all threads; needs a seekable input
+	//and has to come before reader()
+	size_t count_lines() {
+		if (indexed()) {
+			return index.lines();
+		}
+
+		if (map != NULL) {
+			return count_lines_parallel(map->begin(), map->end());
+		}
+
+		if (kind == plain or lines != NULL or ::lseek(fd, 0, SEEK_SET) != 0) {
+			throw std::runtime_error("counting lines needs a seekable input (use --input FILE or redirect a file)");
+		}
+
+		//one pass through the decompressor, then start over
+		size_t count = 0;
+		{
+			fd_source in(fd);
+			source* s = decompressor(in);
+
+			try {
+				std::vector<char> buf(1 << 22);
+				char last = '\n';
+				size_t r;
+				while ((r = s->read(&buf[0], buf.size())) > 0) {
+					count += count_newlines(&buf[0], &buf[0] + r);
+					last = buf[r - 1];
+				}
+				count += (last != '\n');
+			} catch (...) {
+				delete s;
+				throw;
+			}
+
+			delete s;
+		}
+
+		if (::lseek(fd, 0, SEEK_SET) != 0) {
+			throw std::runtime_error(std::string("cannot rewind input: ") + std::strerror(errno));
+		}
+
+		return count;
+	}
+
+	//NULL unless the input is memory mapped
+	const mapped_file* mapping() const { return map; }
+
+private:
+	input(const input&);
+	input& operator=(const input&);
+
+	source* decompressor(fd_source& in) const {
+		switch (kind) {
+			case bgzf:
+				return new bgzf_source(in, indexed() ? &index : NULL);
+			case gzip:
+				return new gzip_source(in);
+			default:
+				return &in;
+		}
+	}
+
+	int fd;
+	bool owned;
+	format kind;
+
+	mapped_file* map;
+	line_index index;
+
+	fd_source* raw;
+	source* src;
+	line_reader* lines;
+};
+
+} }
+
+#endif
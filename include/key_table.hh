@@ -0,0 +1,92 @@
+#ifndef _KEY_TABLE_HH_
+#define _KEY_TABLE_HH_
+
+#include <cstring>
+#include <vector>
+
+/* Numbering of distinct keys
+
+   Keys are byte strings looked up straight from a read buffer. Each new one
+   is copied once into a pool and given the next number; lookups hash the
+   bytes (FNV-1a, mixed) into an open addressing table with linear probing, so no
+   string is built per lookup. */
+
+namespace misc { namespace io {
+
+class key_table {
+public:
+	key_table() : table(16, empty) {}
+
+	//number of [p, p + len), given the next one if it is new
+	size_t find_or_insert(const char* p, size_t len) {
+		unsigned long long h = hash(p, len);
+		size_t mask = table.size() - 1;
+
+		size_t i = size_t(h) & mask;
+		for (; table[i] != empty; i = (i + 1) & mask) {
+			const key& k = keys[table[i]];
+			if (k.hash == h and k.length == len and (len == 0 or std::memcmp(&pool[k.offset], p, len) == 0)) {
+				return table[i];
+			}
+		}
+
+		key k = { h, pool.size(), len };
+		pool.insert(pool.end(), p, p + len);
+		keys.push_back(k);
+		table[i] = keys.size() - 1;
+
+		//at most half full
+		if (2 * keys.size() > table.size()) {
+			grow();
+		}
+		return keys.size() - 1;
+	}
+
+	//distinct keys so far
+	size_t size() const { return keys.size(); }
+
+private:
+	static const size_t empty = size_t(-1);
+
+	struct key {
+		unsigned long long hash;
+		size_t offset, length;
+	};
+
+	static unsigned long long hash(const char* p, size_t len) {
+		unsigned long long h = 14695981039346656037ULL;
+		for (size_t i = 0; i < len; ++i) {
+			h = (h ^ (unsigned char) p[i]) * 1099511628211ULL;
+		}
+
+		//the table is indexed by the low bits, which FNV only mixes upwards
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33;
+		return h;
+	}
+
+	//twice the slots, the keys placed again by their stored hashes
+	void grow() {
+		std::vector<size_t> bigger(2 * table.size(), empty);
+		size_t mask = bigger.size() - 1;
+
+		for (size_t k = 0; k < keys.size(); ++k) {
+			size_t i = size_t(keys[k].hash) & mask;
+			while (bigger[i] != empty) {
+				i = (i + 1) & mask;
+			}
+			bigger[i] = k;
+		}
+		table.swap(bigger);
+	}
+
+	std::vector<size_t> table;
+
+	std::vector<key> keys;
+	std::vector<char> pool;
+};
+
+} }
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef _LINE_ARENA_HH_
+#define _LINE_ARENA_HH_
+
+#include <cstring>
+#include <vector>
+
+/* Pooled storage for a fixed set of lines that get replaced over time
+
+   Every line lives in one contiguous byte store. A slot that is assigned a
+   line no longer than the one it holds is overwritten in place; otherwise
+   the line is appended and the old bytes become garbage, which is squeezed
+   out once it makes up half the store. */
+
+namespace misc { namespace io {
+
+class line_arena {
+public:
+	line_arena(size_t slots = 0)
+	: entries(slots), garbage(0) {
+	}
+
+	size_t slots() const { return entries.size(); }
+
+	//add a new slot holding [p, p + len); returns its number
+	size_t push(const char* p, size_t len) {
+		entries.push_back(entry());
+		assign(entries.size() - 1, p, len);
+		return entries.size() - 1;
+	}
+
+	void assign(size_t slot, const char* p, size_t len) {
+		entry& e = entries[slot];
+
+		if (len <= e.capacity) {
+			if (len > 0) {
+				std::memcpy(&store[e.offset], p, len);
+			}
+			e.length = len;
+			return;
+		}
+
+		garbage += e.capacity;
+		e.length = e.capacity = 0;
+		if (garbage > (1 << 20) and garbage > store.size() / 2) {
+			compact();
+		}
+
+		e.offset = store.size();
+		e.length = e.capacity = len;
+		store.insert(store.end(), p, p + len);
+	}
+
+	const char* data(size_t slot) const {
+		return store.empty() ? NULL : &store[entries[slot].offset];
+	}
+
+	size_t size(size_t slot) const {
+		return entries[slot].length;
+	}
+
+private:
+	struct entry {
+		entry() : offset(0), length(0), capacity(0) {}
+
+		size_t offset, length, capacity;
+	};
+
+	void compact() {
+		std::vector<char> packed;
+		packed.reserve(store.size() - garbage);
+
+		for (std::vector<entry>::iterator it = entries.begin(); it != entries.end(); ++it) {
+			size_t offset = packed.size();
+			packed.insert(packed.end(), store.begin() + it->offset, store.begin() + it->offset + it->length);
+			it->offset = offset;
+			it->capacity = it->length;
+		}
+
+		store.swap(packed);
+		garbage = 0;
+	}
+
+	std::vector<entry> entries;
+	std::vector<char> store;
+
+	size_t garbage;
+};
+
+} }
+
+#endif
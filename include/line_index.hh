@@ -0,0 +1,333 @@
+#ifndef _LINE_INDEX_HH_
+#define _LINE_INDEX_HH_
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#include <stdint.h>
+#include <sys/stat.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "newline.hh"
+#include "mapped_file.hh"
+
+/* Sidecar index of where lines are in a file (FILE.rli)
+
+   For BGZF files the index holds, for every block, its offset in the
+   compressed file and the number of lines that end before it, so that a
+   reader can start inflating at the block that holds a given line.
+
+   For plain text it holds the start of every line: the length of each line
+   as a varint, with the absolute offset of every 256th line kept aside as a
+   checkpoint so that any line start is at most 255 varints away. At one or
+   two bytes a line this index can itself be large, so it is memory mapped
+   rather than read in.
+
+   The file starts with a fixed header (magic, kind, size and modification
+   time of the indexed file, total lines, number of entries, size of the
+   varint stream) followed by the varint stream padded to 8 bytes, then the
+   entries, all as little endian 64 bit words. */
+
+namespace misc { namespace io {
+
+class line_index {
+public:
+	enum kind_type { none = 0, bgzf_blocks = 1, text_lines = 2 };
+
+	//a BGZF block, or a text checkpoint (line offset, position in the stream)
+	struct block {
+		uint64_t offset, lines;
+	};
+
+	static const size_t checkpoint_every = 256;
+
+	line_index()
+	: kind(none), size(0), mtime(0), total(0), file(NULL), stream(NULL), entries(NULL), num_entries(0) {
+	}
+
+	~line_index() {
+		delete file;
+	}
+
+	static std::string sidecar(const std::string& path) {
+		return path + ".rli";
+	}
+
+	kind_type type() const { return kind; }
+
+	//total lines in the indexed file
+	size_t lines() const { return total; }
+
+	//the block a reader has to start at to reach the start of line (0-based):
+	//the last one with fewer than line lines before it
+	size_t find_block(size_t line) const {
+		//first block with line or more lines before it
+		const block* it = std::lower_bound(entries, entries + num_entries, line, before);
+		return (it == entries) ? 0 : (it - entries) - 1;
+	}
+
+	const block& operator[](size_t i) const { return entries[i]; }
+	size_t num_blocks() const { return num_entries; }
+
+	//offset of the start of line (0-based) in a text index
+	uint64_t line_start(size_t line) const {
+		const block& c = entries[line / checkpoint_every];
+
+		uint64_t offset = c.offset;
+		const unsigned char* p = stream + c.lines;
+		for (size_t i = line % checkpoint_every; i > 0; --i) {
+			offset += get_varint(p);
+		}
+		return offset;
+	}
+
+	//start an empty index of the given kind for the file open on fd
+	void reset(kind_type k, int fd) {
+		struct stat st;
+		if (::fstat(fd, &st) != 0) {
+			throw std::runtime_error(std::string("cannot stat input: ") + std::strerror(errno));
+		}
+		kind = k;
+		size = st.st_size;
+		mtime = st.st_mtime;
+		total = 0;
+		blocks.clear();
+		entries = NULL;
+		num_entries = 0;
+	}
+
+	void add_block(uint64_t offset, uint64_t lines) {
+		block b = { offset, lines };
+		blocks.push_back(b);
+		entries = &blocks[0];
+		num_entries = blocks.size();
+	}
+
+	void set_lines(size_t lines) { total = lines; }
+
+	void save(const std::string& path) const {
+		FILE* f = std::fopen(path.c_str(), "wb");
+		if (f == NULL) {
+			throw std::runtime_error("cannot write " + path + ": " + std::strerror(errno));
+		}
+
+		bool ok = write_header(f, num_entries, 0);
+		if (num_entries > 0) {
+			ok = ok and std::fwrite(entries, sizeof(block), num_entries, f) == num_entries;
+		}
+
+		if (std::fclose(f) != 0 or not ok) {
+			throw std::runtime_error("cannot write " + path);
+		}
+	}
+
+	//load the index at path and check it belongs to the file open on fd;
+	//false if there is no index
+	bool load(const std::string& path, int fd) {
+		FILE* f = std::fopen(path.c_str(), "rb");
+		if (f == NULL) {
+			return false;
+		}
+
+		uint64_t header[8];
+		bool ok = std::fread(header, sizeof(header), 1, f) == 1 and header[0] == magic;
+		if (ok) {
+			kind = kind_type(header[1]);
+			size = header[2];
+			mtime = header[3];
+			total = header[4];
+
+			if (kind == bgzf_blocks) {
+				blocks.resize(header[5]);
+				if (not blocks.empty()) {
+					ok = std::fread(&blocks[0], sizeof(block), blocks.size(), f) == blocks.size();
+				}
+				entries = blocks.empty() ? NULL : &blocks[0];
+				num_entries = blocks.size();
+			} else if (kind == text_lines) {
+				file = new mapped_file(path);
+
+				const size_t padded = (header[6] + 7) & ~size_t(7);
+				ok = file->size() == sizeof(header) + padded + header[5] * sizeof(block);
+				if (ok) {
+					stream = (const unsigned char*) file->begin() + sizeof(header);
+					entries = (const block*) (file->begin() + sizeof(header) + padded);
+					num_entries = header[5];
+					file->random_access(0, file->size());
+				}
+			} else {
+				ok = false;
+			}
+		}
+		std::fclose(f);
+
+		if (not ok) {
+			throw std::runtime_error("corrupt index " + path);
+		}
+
+		struct stat st;
+		if (::fstat(fd, &st) != 0 or uint64_t(st.st_size) != size or uint64_t(st.st_mtime) != mtime) {
+			throw std::runtime_error("index " + path + " is out of date -- rebuild it with random-lines-index");
+		}
+
+		return true;
+	}
+
+	bool write_header(FILE* f, uint64_t entries, uint64_t stream_size) const {
+		uint64_t header[8] = { magic, uint64_t(kind), size, mtime, total, entries, stream_size, 0 };
+		return std::fwrite(header, sizeof(header), 1, f) == 1;
+	}
+
+	static void put_varint(std::vector<unsigned char>& out, uint64_t x) {
+		while (x >= 0x80) {
+			out.push_back((unsigned char) (x | 0x80));
+			x >>= 7;
+		}
+		out.push_back((unsigned char) x);
+	}
+
+	static uint64_t get_varint(const unsigned char*& p) {
+		uint64_t x = 0;
+		for (int shift = 0; ; shift += 7) {
+			unsigned char b = *p++;
+			x |= uint64_t(b & 0x7f) << shift;
+			if (b < 0x80) break;
+		}
+		return x;
+	}
+
+private:
+	line_index(const line_index&);
+	line_index& operator=(const line_index&);
+
+	static bool before(const block& b, size_t line) {
+		return b.lines < line;
+	}
+
+	//"RLINDEX1"
+	static const uint64_t magic = 0x315845444e494c52ULL;
+
+	kind_type kind;
+	uint64_t size, mtime, total;
+
+	//entries live in blocks, or in the mapped index file
+	std::vector<block> blocks;
+
+	mapped_file* file;
+	const unsigned char* stream;
+	const block* entries;
+	size_t num_entries;
+};
+
+//write a text line index of the mapped file (open on fd) to path; pieces of
+//the file are counted and encoded on all OpenMP threads, a round at a time
+inline void text_build_index(const mapped_file& map, int fd, const std::string& path, size_t piece = 1 << 26) {
+	line_index index;
+	index.reset(line_index::text_lines, fd);
+
+	FILE* f = std::fopen(path.c_str(), "wb");
+	if (f == NULL) {
+		throw std::runtime_error("cannot write " + path + ": " + std::strerror(errno));
+	}
+
+	//placeholder until the counts are known
+	bool ok = index.write_header(f, 0, 0);
+
+	std::vector<const char*> bounds = split_lines(map.begin(), map.end(), map.size() / piece + 1);
+	const long pieces = long(bounds.size()) - 1;
+
+#ifdef _OPENMP
+	const long round = omp_get_max_threads();
+#else
+	const long round = 1;
+#endif
+
+	std::vector<size_t> counts(round);
+	std::vector<std::vector<unsigned char> > streams(round);
+	std::vector<std::vector<line_index::block> > checkpoints(round);
+
+	//line 0 starts at 0, at the start of the stream
+	line_index::block first = { 0, 0 };
+	std::vector<line_index::block> all(1, first);
+
+	uint64_t lines = 0, written = 0;
+
+	for (long r = 0; r < pieces; r += round) {
+		const long count = std::min(round, pieces - r);
+
+		#pragma omp parallel for
+		for (long i = 0; i < count; ++i) {
+			counts[i] = count_lines(bounds[r + i], bounds[r + i + 1]);
+		}
+
+		#pragma omp parallel for
+		for (long i = 0; i < count; ++i) {
+			std::vector<unsigned char>& out = streams[i];
+			std::vector<line_index::block>& cps = checkpoints[i];
+			out.clear();
+			cps.clear();
+
+			//the first line of this piece
+			uint64_t line = lines;
+			for (long j = 0; j < i; ++j) {
+				line += counts[j];
+			}
+
+			//every line records where the one after it starts: as a
+			//checkpoint, or as its own length
+			const char* p = bounds[r + i];
+			const char* end = bounds[r + i + 1];
+			while (p < end) {
+				const char* q = (const char*) std::memchr(p, '\n', end - p);
+				const char* next = q ? q + 1 : end;
+
+				++line;
+				if (next < map.end()) {
+					if (line % line_index::checkpoint_every == 0) {
+						line_index::block c = { uint64_t(next - map.begin()), out.size() };
+						cps.push_back(c);
+					} else {
+						line_index::put_varint(out, next - p);
+					}
+				}
+				p = next;
+			}
+		}
+
+		for (long i = 0; i < count; ++i) {
+			for (size_t j = 0; j < checkpoints[i].size(); ++j) {
+				checkpoints[i][j].lines += written;
+				all.push_back(checkpoints[i][j]);
+			}
+			if (not streams[i].empty()) {
+				ok = ok and std::fwrite(&streams[i][0], 1, streams[i].size(), f) == streams[i].size();
+			}
+			written += streams[i].size();
+			lines += counts[i];
+		}
+	}
+
+	static const char pad[8] = { 0 };
+	const size_t padding = (8 - written % 8) % 8;
+	ok = ok and std::fwrite(pad, 1, padding, f) == padding;
+	ok = ok and std::fwrite(&all[0], sizeof(line_index::block), all.size(), f) == all.size();
+
+	index.set_lines(lines);
+	ok = ok and std::fseek(f, 0, SEEK_SET) == 0 and index.write_header(f, all.size(), written);
+
+	if (std::fclose(f) != 0 or not ok) {
+		throw std::runtime_error("cannot write " + path);
+	}
+}
+
+} }
+
+#endif
@@ -0,0 +1,391 @@
+#ifndef _LINE_READER_HH_
+#define _LINE_READER_HH_
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include "newline.hh"
+#include "source.hh"
+#include "mapped_file.hh"
+#include "line_index.hh"
+#include "run_stats.hh"
+
+/* Block-buffered line scanner
+
+   Pulls large blocks from a source (a file descriptor or a decompressor)
+   and walks over newlines in place. Skipped lines are never copied; only the lines handed
+   out by next() are looked at, and those point straight into the buffer.
+
+   A reader over a mapped_file walks the mapping itself in windows, asking
+   the kernel to read ahead of each window; spans then stay valid for as
+   long as the mapping does. With a text line_index it moves straight to the
+   start of a line that lies past the current window, and the windows start
+   small again from there.
+
+   Given run_counters, the reader counts the bytes it reads and the lines it
+   hands out and skips, and is in the read phase while it waits on its
+   source. */
+
+namespace misc { namespace io {
+
+class line_reader {
+public:
+	line_reader(source& src, size_t block_size = 1 << 22)
+	: src(&src), map(NULL), index(NULL), block_size(block_size), window(block_size), capacity(block_size), eof(false), consumed(0), ahead(0), stats(NULL), limit(NULL) {
+
+		buf = (char*) std::malloc(capacity);
+		if (buf == NULL) {
+			throw std::bad_alloc();
+		}
+		pos = end = buf;
+	}
+
+	line_reader(const mapped_file& map, const line_index* index = NULL, size_t block_size = 1 << 24)
+	: src(NULL), map(&map), index(index), block_size(block_size), window(block_size), capacity(0), eof(false), consumed(0), ahead(0), stats(NULL) {
+
+		buf = pos = end = (char*) map.begin();
+		limit = map.end();
+		map.will_need(0, block_size);
+	}
+
+	//reader over the part [begin, end) of a mapping
+	line_reader(const mapped_file& map, const char* begin, const char* end, size_t block_size = 1 << 24)
+	: src(NULL), map(&map), index(NULL), block_size(block_size), window(block_size), capacity(0), eof(false), consumed(0), ahead(0), stats(NULL) {
+
+		buf = pos = this->end = (char*) begin;
+		limit = end;
+		map.will_need(begin - map.begin(), block_size);
+	}
+
+	~line_reader() {
+		if (map == NULL) {
+			std::free(buf);
+		}
+	}
+
+	//spans handed out by next() outlive later calls
+	bool stable() const { return map != NULL; }
+
+	//lines read or skipped so far
+	size_t tell() const { return consumed; }
+
+	//true if skips can jump through a text index
+	bool indexed() const { return index != NULL; }
+
+	//counters to update from here on, or NULL for none
+	void count(run_counters* c) { stats = c; }
+	run_counters* counters() const { return stats; }
+
+	//ask the kernel to start reading line (0-based) now if a later skip
+	//would jump to it rather than scan; lines are to come in ascending order
+	void will_need(size_t line) {
+		ahead = std::max(ahead, consumed);
+		if (index == NULL or line < ahead + line_index::checkpoint_every or line >= index->lines()) {
+			return;
+		}
+		ahead = line;
+		map->will_need(index->line_start(line), 1 << 12);
+	}
+
+	//discard the next k lines; false if the stream ends first
+	bool skip(size_t k) {
+		size_t from = consumed;
+		bool more = skip_lines(k);
+		if (stats != NULL) {
+			stats->lines_skipped += consumed - from;
+		}
+		return more;
+	}
+
+	//span of the next k lines (inner newlines included, last one stripped);
+	//valid until the next call on the reader
+	bool next(const char*& line, size_t& len, size_t k = 1) {
+		size_t scanned = 0, found = 0;
+
+		while (1) {
+			const char* q = find_newline(pos + scanned, end, k - found);
+			if (q != NULL) {
+				line = pos;
+				len = q - pos;
+				pos = (char*) q + 1;
+				handed(k);
+				return true;
+			}
+
+			found += count_newlines(pos + scanned, end);
+			scanned = end - pos;
+
+			if (not fill()) {
+				//unterminated last line
+				if (found == k - 1 and pos != end and end[-1] != '\n') {
+					line = pos;
+					len = end - pos;
+					pos = end;
+					handed(k);
+					return true;
+				}
+				return false;
+			}
+		}
+	}
+
+	//first byte of the next line, which is not consumed; false at the end
+	bool peek(char& c) {
+		while (pos == end) {
+			if (not fill()) {
+				return false;
+			}
+		}
+		c = *pos;
+		return true;
+	}
+
+	//span of the next line and every one after it up to the next line that
+	//starts with c (inner newlines included, last one stripped); valid until
+	//the next call on the reader
+	bool next_until(const char*& span, size_t& len, char c) {
+		size_t scanned = 0;
+
+		while (1) {
+			const char* q = (const char*) std::memchr(pos + scanned, '\n', end - pos - scanned);
+			while (q != NULL and q + 1 < end) {
+				if (q[1] == c) {
+					span = pos;
+					len = q - pos;
+					handed(count_newlines(pos, q + 1));
+					pos = (char*) q + 1;
+					return true;
+				}
+				q = (const char*) std::memchr(q + 1, '\n', end - q - 1);
+			}
+
+			//a newline at the very end is looked at again with what follows
+			scanned = (q != NULL ? q : end) - pos;
+
+			if (not fill()) {
+				if (pos == end) {
+					return false;
+				}
+				span = pos;
+				len = end - pos - (end[-1] == '\n');
+				handed(count_newlines(pos, end) + (end[-1] != '\n'));
+				pos = end;
+				return true;
+			}
+		}
+	}
+
+	//span of the next line and every one after it with the same key, the
+	//tab separated field number column (0-based) of each line; inner
+	//newlines included, last one stripped, valid until the next call
+	bool next_group(const char*& span, size_t& len, size_t column) {
+		//offsets from pos, which fill() moves: the key of the group and the
+		//line looked at
+		size_t key = 0, key_len = 0, line = 0;
+		bool first = true;
+
+		while (1) {
+			const char* q;
+			while ((q = (const char*) std::memchr(pos + line, '\n', end - pos - line)) != NULL) {
+				if (not same_key(pos + line, q, column, first, key, key_len)) {
+					return next_group_end(span, len, pos + line);
+				}
+				line = q + 1 - pos;
+			}
+
+			if (not fill()) {
+				if (pos == end) {
+					return false;
+				}
+
+				//an unterminated last line may still start a group of its own
+				if (pos + line < end and not same_key(pos + line, end, column, first, key, key_len)) {
+					return next_group_end(span, len, pos + line);
+				}
+
+				span = pos;
+				len = end - pos - (end[-1] == '\n');
+				handed(count_newlines(pos, end) + (end[-1] != '\n'));
+				pos = end;
+				return true;
+			}
+		}
+	}
+
+private:
+	//skip() but for the counting
+	bool skip_lines(size_t k) {
+		//an indexed source may get there without reading what is in between
+		size_t before;
+		if (k > 0 and src != NULL and src->jump(consumed + k, before)) {
+			k = consumed + k - before;
+			consumed = before;
+			pos = end = buf;
+		}
+
+		//short skips are cheaper to scan than to look up
+		if (k >= line_index::checkpoint_every and index != NULL and consumed + k < index->lines()) {
+			const char* p = map->begin() + index->line_start(consumed + k);
+			if (p > end) {
+				pos = end = (char*) p;
+				consumed += k;
+				k = 0;
+
+				window = 1 << 16;
+				map->will_need(p - map->begin(), window);
+			}
+		}
+
+		while (k > 0) {
+			const char* q = find_newline(pos, end, k);
+			if (q != NULL) {
+				pos = (char*) q + 1;
+				consumed += k;
+				return true;
+			}
+
+			bool partial = (pos != end and end[-1] != '\n');
+
+			size_t c = count_newlines(pos, end);
+			k -= c;
+			consumed += c;
+			pos = end;
+
+			if (not fill()) {
+				//an unterminated last line still counts
+				if (k == 1 and partial) {
+					++consumed;
+					return true;
+				}
+				return false;
+			}
+		}
+		return true;
+	}
+
+	//false if the key of the line [b, e) differs from the group's, which the
+	//first line sets
+	bool same_key(const char* b, const char* e, size_t column, bool& first, size_t& key, size_t& key_len) const {
+		for (size_t c = 0; c < column and b != e; ++c) {
+			const char* t = (const char*) std::memchr(b, '\t', e - b);
+			b = (t != NULL) ? t + 1 : e;
+		}
+		const char* t = (const char*) std::memchr(b, '\t', e - b);
+		size_t n = ((t != NULL) ? t : e) - b;
+
+		if (first) {
+			first = false;
+			key = b - pos;
+			key_len = n;
+			return true;
+		}
+		return n == key_len and std::memcmp(b, pos + key, n) == 0;
+	}
+
+	//the group is [pos, next), ending with the newline before next
+	bool next_group_end(const char*& span, size_t& len, const char* next) {
+		span = pos;
+		len = next - 1 - pos;
+		handed(count_newlines(pos, next));
+		pos = (char*) next;
+		return true;
+	}
+
+	//k more lines handed out
+	void handed(size_t k) {
+		consumed += k;
+		if (stats != NULL) {
+			stats->lines_read += k;
+		}
+	}
+
+	//keep [pos, end), move it to the front and read more behind it
+	bool fill() {
+		if (eof) {
+			return false;
+		}
+
+		if (map != NULL) {
+			return slide();
+		}
+
+		size_t keep = end - pos;
+		if (keep > 0 and pos != buf) {
+			std::memmove(buf, pos, keep);
+		}
+
+		if (capacity - keep < block_size) {
+			capacity = keep + block_size;
+			char* p = (char*) std::realloc(buf, capacity);
+			if (p == NULL) {
+				throw std::bad_alloc();
+			}
+			buf = p;
+		}
+
+		pos = buf;
+		end = buf + keep;
+
+		size_t r;
+		{
+			run_phase phase(stats, run_counters::read);
+			r = src->read(end, capacity - keep);
+		}
+		if (r == 0) {
+			eof = true;
+			return false;
+		}
+
+		end += r;
+		if (stats != NULL) {
+			stats->bytes_read += r;
+		}
+		return true;
+	}
+
+	//move the window end forward over the mapping
+	bool slide() {
+		if (end == limit) {
+			eof = true;
+			return false;
+		}
+
+		size_t len = std::min(window, size_t(limit - end));
+		end += len;
+		if (stats != NULL) {
+			stats->bytes_read += len;
+		}
+
+		window = std::min(2 * window, block_size);
+		map->will_need(end - map->begin(), window);
+		return true;
+	}
+
+private:
+	source* src;
+	const mapped_file* map;
+	const line_index* index;
+
+	size_t block_size, window, capacity;
+	bool eof;
+
+	size_t consumed;
+
+	//last line handed to will_need()
+	size_t ahead;
+
+	run_counters* stats;
+
+	char* buf;
+	char* pos;
+	char* end;
+
+	//end of the mapped range
+	const char* limit;
+};
+
+} }
+
+#endif
@@ -0,0 +1,182 @@
+#ifndef _LINE_WRITER_HH_
+#define _LINE_WRITER_HH_
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "run_stats.hh"
+
+/* Buffered line output
+
+   Lines are gathered into a list of iovecs and handed to writev(2) in large
+   batches instead of being flushed one at a time. Short lines, and lines
+   whose bytes will not outlive the call (a streamed buffer), are copied into
+   a write buffer; long lines that stay put (a memory mapping, an arena that
+   is no longer written to) are referenced where they are, so their bytes go
+   from the source pages to the output without another copy.
+
+   Given run_counters, the writer counts the records and bytes it writes and
+   is in the write phase while it does. */
+
+namespace misc { namespace io {
+
+class line_writer {
+public:
+	line_writer(int fd = STDOUT_FILENO, size_t buffer_size = 1 << 20)
+	: fd(fd), owned(false), buf(buffer_size), used(0), stats(NULL) {
+		iov.reserve(max_iov);
+	}
+
+	//creates or truncates path, which is closed again with the writer
+	line_writer(const std::string& path, size_t buffer_size = 1 << 20)
+	: fd(-1), owned(true), buf(buffer_size), used(0), stats(NULL) {
+		fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+		if (fd < 0) {
+			throw std::runtime_error("cannot open " + path + ": " + std::strerror(errno));
+		}
+		iov.reserve(max_iov);
+	}
+
+	//whatever is left is written out; errors here have nowhere to go
+	~line_writer() {
+		try {
+			flush();
+		} catch (...) {
+		}
+		if (owned) {
+			::close(fd);
+		}
+	}
+
+	//counters to update from here on, or NULL for none
+	void count(run_counters* c) { stats = c; }
+
+	//[p, p + len) and a newline; a stable line is only referenced and has
+	//to stay valid until the next flush()
+	void write(const char* p, size_t len, bool stable = false) {
+		run_phase phase(stats, run_counters::write);
+		if (stats != NULL) {
+			++stats->records_written;
+			stats->bytes_written += len + 1;
+		}
+
+		if (stable and len >= reference_min) {
+			if (iov.size() + 2 > max_iov) {
+				flush();
+			}
+			add(p, len);
+			copy("\n", 1);
+			return;
+		}
+
+		if (len + 1 > buf.size() - used) {
+			flush();
+
+			//too long for the buffer at all: write it through
+			if (len + 1 > buf.size()) {
+				add(p, len);
+				copy("\n", 1);
+				flush();
+				return;
+			}
+		}
+
+		copy(p, len);
+		copy("\n", 1);
+	}
+
+	void flush() {
+		run_phase phase(stats, run_counters::write);
+		size_t first = 0;
+
+		while (first < iov.size()) {
+			int count = int(std::min(iov.size() - first, size_t(max_iov)));
+
+			ssize_t r = ::writev(fd, &iov[first], count);
+			if (r < 0) {
+				if (errno == EINTR) continue;
+				iov.clear();
+				used = 0;
+				throw std::runtime_error(std::string("write failed: ") + std::strerror(errno));
+			}
+
+			//skip what went out, which may end part way through an iovec
+			size_t done = r;
+			while (first < iov.size() and done >= iov[first].iov_len) {
+				done -= iov[first].iov_len;
+				++first;
+			}
+			if (done > 0) {
+				iov[first].iov_base = (char*) iov[first].iov_base + done;
+				iov[first].iov_len -= done;
+			}
+		}
+
+		iov.clear();
+		used = 0;
+	}
+
+private:
+	line_writer(const line_writer&);
+	line_writer& operator=(const line_writer&);
+
+	//shorter stable lines are cheaper to copy than to give their own iovec
+	static const size_t reference_min = 256;
+
+#ifdef IOV_MAX
+	static const size_t max_iov = IOV_MAX;
+#else
+	static const size_t max_iov = 1024;
+#endif
+
+	//append to the write buffer, growing the last iovec if it ends there
+	void copy(const char* p, size_t len) {
+		char* dst = &buf[0] + used;
+		bool grow = not iov.empty() and (char*) iov.back().iov_base + iov.back().iov_len == dst;
+
+		if (len > buf.size() - used or (not grow and iov.size() == max_iov)) {
+			flush();
+			dst = &buf[0];
+			grow = false;
+		}
+
+		std::memcpy(dst, p, len);
+		used += len;
+
+		if (grow) {
+			iov.back().iov_len += len;
+		} else {
+			add(dst, len);
+		}
+	}
+
+	void add(const char* p, size_t len) {
+		struct iovec v;
+		v.iov_base = (void*) p;
+		v.iov_len = len;
+		iov.push_back(v);
+	}
+
+	int fd;
+	bool owned;
+
+	std::vector<char> buf;
+	size_t used;
+
+	std::vector<struct iovec> iov;
+
+	run_counters* stats;
+};
+
+} }
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef _MAPPED_FILE_HH_
+#define _MAPPED_FILE_HH_
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Read-only memory mapping of a regular file */
+
+namespace misc { namespace io {
+
+class mapped_file {
+public:
+	mapped_file(const std::string& path)
+	: data(NULL), length(0) {
+
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			throw std::runtime_error("cannot open " + path + ": " + std::strerror(errno));
+		}
+
+		try {
+			map(fd);
+		} catch (...) {
+			::close(fd);
+			throw;
+		}
+		::close(fd);
+	}
+
+	mapped_file(int fd)
+	: data(NULL), length(0) {
+		map(fd);
+	}
+
+	~mapped_file() {
+		if (data != NULL) {
+			::munmap((void*) data, length);
+		}
+	}
+
+	//true if fd refers to something that can be mapped
+	static bool mappable(int fd) {
+		struct stat st;
+		return ::fstat(fd, &st) == 0 and S_ISREG(st.st_mode);
+	}
+
+	const char* begin() const { return data; }
+	const char* end() const { return data + length; }
+	size_t size() const { return length; }
+
+	//hint the kernel to start reading [offset, offset + len) in
+	void will_need(size_t offset, size_t len) const {
+		advise(offset, len, MADV_WILLNEED);
+	}
+
+	//hint the kernel that [offset, offset + len) will be touched at random
+	void random_access(size_t offset, size_t len) const {
+		advise(offset, len, MADV_RANDOM);
+	}
+
+private:
+	mapped_file(const mapped_file&);
+	mapped_file& operator=(const mapped_file&);
+
+	void map(int fd) {
+		struct stat st;
+		if (::fstat(fd, &st) != 0) {
+			throw std::runtime_error(std::string("cannot stat input: ") + std::strerror(errno));
+		}
+		if (not S_ISREG(st.st_mode)) {
+			throw std::runtime_error("input is not a regular file");
+		}
+
+		length = st.st_size;
+		if (length == 0) {
+			return;
+		}
+
+		void* p = ::mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+		if (p == MAP_FAILED) {
+			throw std::runtime_error(std::string("mmap failed: ") + std::strerror(errno));
+		}
+		data = (const char*) p;
+
+		//the whole file is scanned front to back
+		::madvise(p, length, MADV_SEQUENTIAL);
+	}
+
+	void advise(size_t offset, size_t len, int advice) const {
+		if (offset >= length) {
+			return;
+		}
+
+		//madvise wants a page aligned start
+		static const size_t page = ::sysconf(_SC_PAGESIZE);
+		size_t start = offset - offset % page;
+		size_t stop = (len > length - offset) ? length : offset + len;
+		::madvise((void*) (data + start), stop - start, advice);
+	}
+
+	const char* data;
+	size_t length;
+};
+
+} }
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef _NEWLINE_HH_
+#define _NEWLINE_HH_
+
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* Newline counting and searching over raw byte ranges */
+
+namespace misc { namespace io {
+
+	//count '\n' bytes in [p, end)
+	inline size_t count_newlines(const char* p, const char* end) {
+		size_t count = 0;
+
+#ifdef __SSE2__
+		const __m128i nl = _mm_set1_epi8('\n');
+		const __m128i zero = _mm_setzero_si128();
+
+		while (end - p >= 16) {
+			//byte-wise accumulators overflow after 255 rounds
+			size_t rounds = size_t(end - p) / 16;
+			if (rounds > 255) rounds = 255;
+
+			__m128i acc = _mm_setzero_si128();
+			for (size_t r = 0; r < rounds; ++r, p += 16) {
+				__m128i v = _mm_loadu_si128((const __m128i*) p);
+				acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(v, nl));
+			}
+
+			__m128i sums = _mm_sad_epu8(acc, zero);
+			count += size_t(_mm_cvtsi128_si32(sums)) + size_t(_mm_extract_epi16(sums, 4));
+		}
+#endif
+
+		for (; p < end; ++p) {
+			count += (*p == '\n');
+		}
+
+		return count;
+	}
+
+	//number of lines in [p, end); an unterminated last line counts
+	inline size_t count_lines(const char* p, const char* end) {
+		if (p == end) {
+			return 0;
+		}
+		return count_newlines(p, end) + (end[-1] != '\n');
+	}
+
+	//count_lines() split over fixed size chunks on all OpenMP threads
+	inline size_t count_lines_parallel(const char* p, const char* end, size_t chunk = 1 << 22) {
+		if (p == end) {
+			return 0;
+		}
+
+		const long nchunks = long((end - p + chunk - 1) / chunk);
+		size_t count = 0;
+
+		#pragma omp parallel for schedule(dynamic, 4) reduction(+:count)
+		for (long c = 0; c < nchunks; ++c) {
+			const char* b = p + c * chunk;
+			const char* e = (size_t(end - b) > chunk) ? b + chunk : end;
+			count += count_newlines(b, e);
+		}
+
+		return count + (end[-1] != '\n');
+	}
+
+	//cut [p, end) into at most parts pieces, each ending just past a newline
+	//(or at end); returns the piece boundaries, first p and last end
+	inline std::vector<const char*> split_lines(const char* p, const char* end, size_t parts) {
+		std::vector<const char*> bounds(1, p);
+
+		const size_t step = size_t(end - p) / (parts ? parts : 1) + 1;
+
+		for (const char* b = p; b < end; ) {
+			const char* cut = (size_t(end - b) > step) ? b + step : end;
+			if (cut < end) {
+				const char* q = (const char*) std::memchr(cut - 1, '\n', end - cut + 1);
+				cut = q ? q + 1 : end;
+			}
+			bounds.push_back(cut);
+			b = cut;
+		}
+
+		return bounds;
+	}
+
+	//pointer to the k-th (1-based) '\n' in [p, end), or NULL if there are fewer than k
+	inline const char* find_newline(const char* p, const char* end, size_t k) {
+		//for far away newlines count coarse blocks first so that dense newlines
+		//do not cost one memchr each; near ones are found by memchr directly
+		const size_t block = 1 << 12;
+
+		while (k > 64 and size_t(end - p) > block) {
+			size_t c = count_newlines(p, p + block);
+			if (c >= k) break;
+			k -= c;
+			p += block;
+		}
+
+		while (p < end) {
+			const char* q = (const char*) std::memchr(p, '\n', end - p);
+			if (q == NULL) {
+				return NULL;
+			}
+			if (--k == 0) {
+				return q;
+			}
+			p = q + 1;
+		}
+
+		return NULL;
+	}
+
+} }
+
+#endif
@@ -0,0 +1,148 @@
+#ifndef _RECORD_READER_HH_
+#define _RECORD_READER_HH_
+
+#include <string>
+#include <stdexcept>
+
+#include "line_reader.hh"
+
+/* Record framing over a line_reader
+
+   A record is a run of whole lines, handed out as one span straight from
+   the reader's buffer: a fixed number of lines (pairs are 2, FASTQ is 4),
+   or a FASTA entry, from one '>' line up to the next. SAM starts with a
+   header of '@' lines that is passed through rather than sampled, and one
+   alignment per line follows. Records are counted from 0 after the header.
+
+   Single lines may instead be grouped: consecutive lines with the same key,
+   a tab separated column (QNAME for SAM), make one record, so that mates
+   and secondary alignments stay together. Keys are compared in place. */
+
+namespace misc { namespace io {
+
+class record_reader {
+public:
+	enum format { lines, fasta, sam };
+
+	//k lines to a record for the line formats, or lines grouped by the key
+	//in column group (1-based) if that is not 0
+	record_reader(line_reader& reader, format kind = lines, size_t k = 1, size_t group = 0)
+	: reader(reader), kind(kind), k(kind == fasta ? 1 : k), group(group), first(0), records(0) {
+		if (k == 0) {
+			throw std::runtime_error("records need at least one line");
+		}
+		if (group > 0 and (kind == fasta or k > 1)) {
+			throw std::runtime_error("only single lines can be grouped");
+		}
+	}
+
+	//"lines", "fastq", "fasta" or "sam", with the lines of a record for "lines"
+	static record_reader parse(line_reader& reader, const std::string& name, size_t k = 1, size_t group = 0) {
+		if (name == "lines") {
+			return record_reader(reader, lines, k, group);
+		} else if (name == "fastq") {
+			return record_reader(reader, lines, 4, group);
+		} else if (name == "fasta") {
+			return record_reader(reader, fasta, 1, group);
+		} else if (name == "sam") {
+			return record_reader(reader, sam, 1, group);
+		}
+		throw std::runtime_error("unknown record format: " + name);
+	}
+
+	//the next header line, which comes before any record; false once the
+	//records start
+	bool header(const char*& line, size_t& len) {
+		char c;
+		if (kind != sam or reader.tell() != first or not reader.peek(c) or c != '@') {
+			return false;
+		}
+		if (not reader.next(line, len)) {
+			return false;
+		}
+		++first;
+		return true;
+	}
+
+	//discard the next n records; false if the stream ends first
+	bool skip(size_t n) {
+		if (kind != fasta and group == 0) {
+			return reader.skip(n * k);
+		}
+
+		const char* span;
+		size_t len;
+		for (; n > 0; --n) {
+			if (not next(span, len)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	//span of the next record (inner newlines included, last one stripped);
+	//valid until the next call on the reader
+	bool next(const char*& rec, size_t& len) {
+		bool got;
+		if (kind == fasta) {
+			got = reader.next_until(rec, len, '>');
+		} else if (group > 0) {
+			got = reader.next_group(rec, len, group - 1);
+		} else {
+			got = reader.next(rec, len, k);
+		}
+		records += got;
+		return got;
+	}
+
+	//records handed out or skipped so far; at the end of the stream, all of
+	//them
+	size_t tell() const {
+		return (record_lines() > 0) ? (reader.tell() - first) / k : records;
+	}
+
+	//discard every record that is left
+	void skip_rest() {
+		while (skip(size_t(1) << 20)) {
+		}
+	}
+
+	//see line_reader::will_need(); FASTA records and groups are not found
+	//by line
+	void will_need(size_t record) {
+		if (record_lines() > 0) {
+			reader.will_need(first + record * k);
+		}
+	}
+
+	bool stable() const { return reader.stable(); }
+
+	//see line_reader::count()
+	run_counters* counters() const { return reader.counters(); }
+
+	//true if skips can jump through a text index
+	bool indexed() const { return record_lines() > 0 and reader.indexed(); }
+
+	format type() const { return kind; }
+
+	//lines to a record, 0 if that varies
+	size_t record_lines() const { return (kind == fasta or group > 0) ? 0 : k; }
+
+private:
+	line_reader& reader;
+	format kind;
+	size_t k;
+
+	//key column of grouped lines, 0 if not grouped
+	size_t group;
+
+	//header lines before the first record
+	size_t first;
+
+	//records read so far, where they are not a fixed number of lines
+	size_t records;
+};
+
+} }
+
+#endif
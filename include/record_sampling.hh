@@ -0,0 +1,114 @@
+#ifndef _RECORD_SAMPLING_HH_
+#define _RECORD_SAMPLING_HH_
+
+#include <vector>
+#include <iostream>
+
+#include "sequential_sampler.hh"
+#include "bernoulli_sampler.hh"
+#include "record_reader.hh"
+#include "line_writer.hh"
+#include "run_stats.hh"
+
+/* Sampling records in one pass
+
+   The two ways of drawing records that every line format shares: exactly n
+   of N with the sequential sampler, skipping to each drawn record, and each
+   record with probability p with the Bernoulli sampler's skips. Draws are
+   timed as the sample phase of the reader's counters. random-lines and
+   random-lines-pairs both sample through these. */
+
+namespace misc { namespace io {
+
+//positions drawn at a time for an indexed input
+static const size_t sample_batch = 4096;
+
+//the error for an input with fewer records than drawn; the exit status
+inline int premature_end() {
+	std::cerr << "ERROR: Prematurely reached the end of the file stream! -- check if the total lines is set correctly" << std::endl;
+	return 1;
+}
+
+//samp.fill() into positions, in the sample phase
+template<class Sampler>
+size_t sample_positions(Sampler& samp, std::vector<long>& positions, run_counters* stats) {
+	run_phase phase(stats, run_counters::sample);
+	return samp.fill(&positions[0], positions.size());
+}
+
+//samp.sample(), in the sample phase
+template<class Sampler>
+long sample_position(Sampler& samp, run_counters* stats) {
+	run_phase phase(stats, run_counters::sample);
+	return samp.sample();
+}
+
+//samp.skip(), in the sample phase
+template<class Sampler>
+long sample_skip(Sampler& samp, run_counters* stats) {
+	run_phase phase(stats, run_counters::sample);
+	return samp.skip();
+}
+
+//exactly n of N records, in one pass
+template<class RNG>
+int sample_sequential(record_reader& reader, line_writer& out, long n, long N, RNG& rng) {
+
+	math::basic_sequential_sampler<RNG> samp(n, N, rng);
+
+	//with an index a block of positions is drawn at once, so that their
+	//reads are under way together; elsewhere drawing between reads overlaps
+	//better with the scan
+	std::vector<long> positions(reader.indexed() ? sample_batch : 1);
+	size_t seekline, currline = 0, count;
+	const char* line;
+	size_t len;
+
+	while ((count = sample_positions(samp, positions, reader.counters())) > 0) {
+
+		if (reader.indexed()) {
+			for (size_t i = 0; i < count; ++i) {
+				reader.will_need(positions[i] - 1);
+			}
+		}
+
+		for (size_t i = 0; i < count; ++i) {
+
+			seekline = positions[i];
+
+			if (not reader.skip(seekline - currline - 1) or not reader.next(line, len)) {
+				return premature_end();
+			}
+
+			currline = seekline;
+
+			out.write(line, len, reader.stable());
+		}
+	}
+
+	out.flush();
+
+	return 0;
+}
+
+//every record with probability p, in one streaming pass
+template<class RNG>
+int sample_bernoulli(record_reader& reader, line_writer& out, double p, RNG& rng) {
+
+	math::basic_bernoulli_sampler<RNG> samp(p, rng);
+
+	const char* line;
+	size_t len;
+
+	while (reader.skip(sample_skip(samp, reader.counters())) and reader.next(line, len)) {
+		out.write(line, len, reader.stable());
+	}
+
+	out.flush();
+
+	return 0;
+}
+
+} }
+
+#endif
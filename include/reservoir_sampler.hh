@@ -0,0 +1,53 @@
+#ifndef _RESERVOIR_SAMPLER_H_
+#define _RESERVOIR_SAMPLER_H_
+
+#include <cmath>
+#include <climits>
+
+#include "rng.hh"
+
+namespace math {
+
+/* Reservoir sampling for streams of unknown length (Li 1994, Algorithm L)
+
+   The first n items fill the reservoir. After that, skip() says how many
+   items to pass over before the next one replaces the reservoir entry named
+   by slot(). The skips are geometric, so the number of random draws grows
+   with n * log(N/n) instead of N. */
+
+template<class RNG>
+class basic_reservoir_sampler {
+public:
+	basic_reservoir_sampler(long n, RNG& rng)
+	: n(n), rng(rng) {
+
+		w = std::exp(std::log(open_uniform(rng)) / double(n));
+	}
+
+	//items to pass over before the next replacement
+	long skip() {
+		double x = std::floor(std::log(open_uniform(rng)) / std::log1p(-w));
+
+		w *= std::exp(std::log(open_uniform(rng)) / double(n));
+
+		return (x < double(LONG_MAX)) ? long(x) : LONG_MAX;
+	}
+
+	//reservoir entry to replace
+	long slot() {
+		long j = long(double(n) * double(rng));
+		return (j < n) ? j : n - 1;
+	}
+
+private:
+	long n;
+	RNG& rng;
+
+	double w;
+};
+
+typedef basic_reservoir_sampler<math::random> reservoir_sampler;
+
+}
+
+#endif
@@ -4,38 +4,51 @@
 #include <ctime>
 #include <climits>
 
-/* Implementation of the TWISTER algorithm */
+#include <stdint.h>
+
+/* Random number generators
+
+   math::random is the Mersenne TWISTER, kept as the default so that old seeds
+   draw the same lines; its doubles are 32 bit and may be exactly 0 or 1.
+   xoshiro256pp, pcg64 and splitmix64 are faster 64 bit generators whose
+   doubles carry 53 bits and lie strictly inside (0, 1).
+
+   All of them convert to int, unsigned long, long and double the same way,
+   so the samplers take the generator as a template parameter. */
 
 namespace math {
+
+	//seed from the clock for when none is given; differs between calls
+	inline unsigned long clock_seed() {
+		static int diff = 0;
+
+		time_t t = time(NULL);
+		clock_t c = clock();
+
+		int h1 = 0;
+		unsigned char* p1 = (unsigned char*) &t;
+
+		for(size_t i = 0; i < sizeof(t); ++i) {
+			h1 *= UCHAR_MAX + 2U;
+			h1 += p1[i];
+		}
+		int h2 = 0;
+		unsigned char* p2 = (unsigned char*) &c;
+		for(size_t j = 0; j < sizeof(c); ++j) {
+			h2 *= UCHAR_MAX + 2U;
+			h2 += p2[j];
+		}
+
+		return (h1 + diff++) ^ h2;
+	}
+
 	class random {
 	public:
 		random(unsigned long seed = -1) { 
 			
 			if(seed == -1) {
-
-				static int diff = 0;
-
-				time_t t = time(NULL);
-				clock_t c = clock();
-			
-				int h1 = 0;
-				unsigned char* p1 = (unsigned char*) &t;
-			
-				for(size_t i = 0; i < sizeof(t); ++i) {
-					h1 *= UCHAR_MAX + 2U;
-					h1 += p1[i];
-				}
-				int h2 = 0;
-				unsigned char* p2 = (unsigned char*) &c;
-				for(size_t j = 0; j < sizeof(c); ++j) {
-					h2 *= UCHAR_MAX + 2U;
-					h2 += p2[j];
-				}
-
-				init((h1 + diff++) ^ h2);
-				
+				init(clock_seed());
 			} else {
-
 				init(seed);
 			}
 		}
@@ -82,6 +95,12 @@ namespace math {
 		operator double() {
 			return sample() * (1.0 / 4294967295.0);
 		}	
+
+		//move to a new substream (see the note above jump() in engine64)
+		void jump();
+
+		//bits of randomness in a double
+		static const int bits = 32;
 		
 	protected:
 		void init(unsigned long seed) {
@@ -105,7 +124,10 @@ namespace math {
 				x = (mt[i] & UPPER_MASK) | (mt[i + 1] & LOWER_MASK);
 				mt[i] = mt[i + M - N] ^ (x >> 1) ^ mag01[x & 0x1UL];
 			}
-			x = (mt[N - 1] & UPPER_MASK) | (mt[i + 1] & LOWER_MASK);
+			//this used to read mt[N], one past the state, which lands on index
+			//(always N here); keep that value so old seeds still reproduce,
+			//without leaving it to the optimiser
+			x = (mt[N - 1] & UPPER_MASK) | ((unsigned long) N & LOWER_MASK);
 			mt[N - 1] = mt[M - 1] ^ (x >> 1) ^ mag01[x & 0x1UL];
 	
 			index = 0;
@@ -135,6 +157,191 @@ namespace math {
 		int index;
 	};
 
+	//conversions shared by the 64 bit generators; G supplies next() and
+	//jump(), which advances the generator past any draws a substream could
+	//make: copying a generator and jumping the copy once per replicate
+	//hands every --replicates sample its own stream (and --sizes its
+	//subsamples one apart from the main draw), fixed by the seed and the
+	//number of jumps alone
+	template<class G>
+	class engine64 {
+	public:
+		operator int() {
+			return int(self().next() >> 33);
+		}
+
+		operator unsigned long() {
+			return (unsigned long) self().next();
+		}
+
+		operator long() {
+			return long(self().next() >> 1);
+		}
+
+		//top 53 bits, offset by half a step: never 0 or 1
+		operator double() {
+			return (double(self().next() >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+		}
+
+		static const int bits = 53;
+
+	protected:
+		static uint64_t rotl(uint64_t x, int k) {
+			return (x << k) | (x >> (64 - k));
+		}
+
+		static uint64_t rotr(uint64_t x, int k) {
+			return (x >> k) | (x << ((64 - k) & 63));
+		}
+
+	private:
+		G& self() { return static_cast<G&>(*this); }
+	};
+
+	//Steele, Lea and Flood's SplitMix64; also seeds the generators below
+	class splitmix64 : public engine64<splitmix64> {
+	public:
+		splitmix64(unsigned long seed = -1)
+		: state(seed == (unsigned long) -1 ? clock_seed() : seed) {
+		}
+
+		uint64_t next() {
+			uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+			return z ^ (z >> 31);
+		}
+
+		//2^40 draws ahead, leaving 2^24 substreams
+		void jump() {
+			state += 0x9e3779b97f4a7c15ULL << 40;
+		}
+
+	private:
+		uint64_t state;
+	};
+
+	//the Mersenne Twister has no cheap jump; its whole state is refilled
+	//from a 64 bit hash of the current one, which makes streams that only
+	//depend on the seed and on how often jump() was called
+	inline void random::jump() {
+		uint64_t h = 0xcbf29ce484222325ULL ^ uint64_t(index);
+		for(int i = 0; i < N; ++i) {
+			h = (h ^ mt[i]) * 0x100000001b3ULL;
+		}
+
+		splitmix64 mix(h);
+		for(int i = 0; i < N; ++i) {
+			mt[i] = mix.next() & 0xffffffffUL;
+		}
+		index = N;
+	}
+
+	//Blackman and Vigna's xoshiro256++
+	class xoshiro256pp : public engine64<xoshiro256pp> {
+	public:
+		xoshiro256pp(unsigned long seed = -1) {
+			splitmix64 init(seed);
+			for(int i = 0; i < 4; ++i) {
+				s[i] = init.next();
+			}
+		}
+
+		uint64_t next() {
+			const uint64_t result = rotl(s[0] + s[3], 23) + s[0];
+			const uint64_t t = s[1] << 17;
+
+			s[2] ^= s[0];
+			s[3] ^= s[1];
+			s[1] ^= s[2];
+			s[0] ^= s[3];
+			s[2] ^= t;
+			s[3] = rotl(s[3], 45);
+
+			return result;
+		}
+
+		//2^128 draws ahead
+		void jump() {
+			static const uint64_t poly[4] = {
+				0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL, 0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL
+			};
+
+			uint64_t t[4] = { 0, 0, 0, 0 };
+			for(int i = 0; i < 4; ++i) {
+				for(int b = 0; b < 64; ++b) {
+					if(poly[i] & (uint64_t(1) << b)) {
+						for(int j = 0; j < 4; ++j) {
+							t[j] ^= s[j];
+						}
+					}
+					next();
+				}
+			}
+
+			for(int j = 0; j < 4; ++j) {
+				s[j] = t[j];
+			}
+		}
+
+	private:
+		uint64_t s[4];
+	};
+
+#ifdef __SIZEOF_INT128__
+	//O'Neill's PCG64 (128 bit LCG, XSL RR output)
+	class pcg64 : public engine64<pcg64> {
+	public:
+		pcg64(unsigned long seed = -1) {
+			splitmix64 init(seed);
+			uint64_t s0 = init.next(), s1 = init.next(), i0 = init.next(), i1 = init.next();
+
+			state = 0;
+			inc = ((((unsigned __int128) i0 << 64) | i1) << 1) | 1;
+			step();
+			state += ((unsigned __int128) s0 << 64) | s1;
+			step();
+		}
+
+		uint64_t next() {
+			step();
+			return rotr(uint64_t(state >> 64) ^ uint64_t(state), int(state >> 122));
+		}
+
+		//2^64 draws ahead, by squaring the LCG step (Brown 1994)
+		void jump() {
+			unsigned __int128 mult = multiplier(), plus = inc;
+			for(int i = 0; i < 64; ++i) {
+				plus *= mult + 1;
+				mult *= mult;
+			}
+			state = state * mult + plus;
+		}
+
+	private:
+		static unsigned __int128 multiplier() {
+			return ((unsigned __int128) 2549297995355413924ULL << 64) | 4865540595714422341ULL;
+		}
+
+		void step() {
+			state = state * multiplier() + inc;
+		}
+
+		unsigned __int128 state, inc;
+	};
+#endif
+
+	//uniform on (0, 1) from any of the above, for logs that cannot take the
+	//end points
+	template<class RNG>
+	double open_uniform(RNG& rng) {
+		double u;
+		do {
+			u = double(rng);
+		} while (u <= 0.0 or u >= 1.0);
+		return u;
+	}
+
 }
 
 #endif
@@ -0,0 +1,314 @@
+#ifndef _RUN_STATS_HH_
+#define _RUN_STATS_HH_
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+/* Run statistics
+
+   Every thread that reads or writes lines keeps counters of its own, which
+   readers and writers update a block or a line at a time: bytes and lines
+   read, lines skipped over, records and bytes written. A thread also notes
+   the phase it is in (waiting on its source, scanning for newlines, drawing
+   from a sampler, writing) with a plain store on the way in and out.
+
+   Phases are not clocked: a monitor thread looks at every thread's phase
+   every 10 milliseconds and adds the time since it last looked to it, which
+   keeps clock calls off the hot paths. The same thread prints the progress
+   line. Hardware counters come from perf_event_open where the kernel allows
+   it; they follow the threads started after them but only add up a thread's
+   counts once it ends, so OpenMP worker threads, which live until the
+   process exits, are not in the report. */
+
+namespace misc { namespace io {
+
+struct run_counters {
+	enum phase { idle, read, scan, sample, write, phases };
+
+	run_counters()
+	: bytes_read(0), lines_read(0), lines_skipped(0), records_written(0), bytes_written(0), current(idle) {
+		for (int p = 0; p < phases; ++p) {
+			seconds[p] = 0;
+		}
+	}
+
+	//bytes come after decompression; lines read are those handed out, lines
+	//skipped those passed over (or jumped through an index)
+	size_t bytes_read, lines_read, lines_skipped;
+	size_t records_written, bytes_written;
+
+	//what the thread is doing, and the time the monitor saw it spend on each
+	volatile int current;
+	double seconds[phases];
+
+	//threads count into neighbouring counters of a vector; this keeps them
+	//off each other's cache lines
+	char padding[64];
+};
+
+//the thread is in phase p for as long as this is in scope; nothing without
+//counters
+class run_phase {
+public:
+	run_phase(run_counters* c, int p) : c(c), before(0) {
+		if (c != NULL) {
+			before = c->current;
+			c->current = p;
+		}
+	}
+
+	~run_phase() {
+		if (c != NULL) {
+			c->current = before;
+		}
+	}
+
+private:
+	run_phase(const run_phase&);
+	run_phase& operator=(const run_phase&);
+
+	run_counters* c;
+	int before;
+};
+
+//cycles, instructions, cache and branch misses of this thread and the
+//threads it starts from here on, in user space; a started thread counts
+//once it has ended
+class hardware_counters {
+public:
+	enum event { cycles, instructions, cache_misses, branch_misses, events };
+
+	hardware_counters() {
+		for (int e = 0; e < events; ++e) {
+			fd[e] = -1;
+		}
+
+#ifdef __linux__
+		static const unsigned long long config[events] = {
+			PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+			PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+		};
+
+		for (int e = 0; e < events; ++e) {
+			struct perf_event_attr attr;
+			std::memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = config[e];
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			attr.inherit = 1;
+
+			fd[e] = int(::syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+			if (fd[e] < 0) {
+				error = std::strerror(errno);
+				close();
+				return;
+			}
+		}
+#else
+		error = "not supported on this system";
+#endif
+	}
+
+	~hardware_counters() {
+		close();
+	}
+
+	bool available() const { return fd[0] >= 0; }
+
+	//why they are not
+	const std::string& why() const { return error; }
+
+	//count so far, summed over the threads that have ended; 0 if unavailable
+	unsigned long long value(event e) const {
+		unsigned long long v = 0;
+		if (fd[e] < 0 or ::read(fd[e], &v, sizeof(v)) != ssize_t(sizeof(v))) {
+			return 0;
+		}
+		return v;
+	}
+
+private:
+	hardware_counters(const hardware_counters&);
+	hardware_counters& operator=(const hardware_counters&);
+
+	void close() {
+		for (int e = 0; e < events; ++e) {
+			if (fd[e] >= 0) {
+				::close(fd[e]);
+			}
+			fd[e] = -1;
+		}
+	}
+
+	int fd[events];
+	std::string error;
+};
+
+//counters for a number of threads, the monitor that times their phases,
+//and the totals at the end
+class run_stats {
+public:
+	//a progress line on stderr every progress seconds if that is above 0;
+	//hardware counters if asked for
+	run_stats(int threads, double progress = 0, bool hardware = false)
+	: slots(threads), progress(progress), hw(hardware ? new hardware_counters() : NULL), stopping(false), running(false) {
+		start = last = last_progress = now();
+
+		if (pthread_create(&monitor, NULL, run, this) != 0) {
+			delete hw;
+			throw std::runtime_error("cannot start the statistics thread");
+		}
+		running = true;
+	}
+
+	~run_stats() {
+		stop();
+		delete hw;
+	}
+
+	//counters of thread t (as omp_get_thread_num() numbers them)
+	run_counters* thread(int t) { return &slots[t]; }
+
+	//the monitor is done; totals are final from here
+	void stop() {
+		if (running) {
+			stopping = true;
+			pthread_join(monitor, NULL);
+			running = false;
+			last = now();
+		}
+	}
+
+	//totals of every thread, to stderr
+	void report() {
+		stop();
+
+		run_counters total;
+		for (size_t t = 0; t < slots.size(); ++t) {
+			total.bytes_read += slots[t].bytes_read;
+			total.lines_read += slots[t].lines_read;
+			total.lines_skipped += slots[t].lines_skipped;
+			total.records_written += slots[t].records_written;
+			total.bytes_written += slots[t].bytes_written;
+			for (int p = 0; p < run_counters::phases; ++p) {
+				total.seconds[p] += slots[t].seconds[p];
+			}
+		}
+
+		double wall = last - start;
+		double busy = 0;
+		for (int p = run_counters::read; p < run_counters::phases; ++p) {
+			busy += total.seconds[p];
+		}
+
+		std::fprintf(stderr, "%-16s %.3f s\n", "elapsed", wall);
+		std::fprintf(stderr, "%-16s %zu (%.3f GB/s)\n", "bytes read", total.bytes_read, (wall > 0) ? total.bytes_read / wall / 1e9 : 0.0);
+		std::fprintf(stderr, "%-16s %zu\n", "lines read", total.lines_read);
+		std::fprintf(stderr, "%-16s %zu\n", "lines skipped", total.lines_skipped);
+		std::fprintf(stderr, "%-16s %zu\n", "records written", total.records_written);
+		std::fprintf(stderr, "%-16s %zu\n", "bytes written", total.bytes_written);
+
+		static const char* names[run_counters::phases] = { "", "read", "scan", "sample", "write" };
+		for (int p = run_counters::read; p < run_counters::phases; ++p) {
+			std::fprintf(stderr, "%-16s %.3f s (%.1f%%)\n", (std::string("time ") + names[p]).c_str(),
+				total.seconds[p], (busy > 0) ? 100 * total.seconds[p] / busy : 0.0);
+		}
+
+		if (hw == NULL) {
+			return;
+		}
+		if (not hw->available()) {
+			std::fprintf(stderr, "%-16s unavailable (%s)\n", "hardware", hw->why().c_str());
+			return;
+		}
+
+		std::fprintf(stderr, "%-16s main thread and ended threads (OpenMP workers are not included)\n", "hardware");
+		unsigned long long cycles = hw->value(hardware_counters::cycles);
+		unsigned long long instructions = hw->value(hardware_counters::instructions);
+		std::fprintf(stderr, "%-16s %llu\n", "cycles", cycles);
+		std::fprintf(stderr, "%-16s %llu (%.2f per cycle)\n", "instructions", instructions, (cycles > 0) ? double(instructions) / cycles : 0.0);
+		std::fprintf(stderr, "%-16s %llu\n", "cache misses", hw->value(hardware_counters::cache_misses));
+		std::fprintf(stderr, "%-16s %llu\n", "branch misses", hw->value(hardware_counters::branch_misses));
+	}
+
+private:
+	run_stats(const run_stats&);
+	run_stats& operator=(const run_stats&);
+
+	static double now() {
+		struct timespec t;
+		clock_gettime(CLOCK_MONOTONIC, &t);
+		return t.tv_sec + t.tv_nsec * 1e-9;
+	}
+
+	static void* run(void* self) {
+		((run_stats*) self)->watch();
+		return NULL;
+	}
+
+	//every 10 milliseconds until stopped
+	void watch() {
+		struct timespec tick = { 0, 10000000 };
+
+		while (not stopping) {
+			nanosleep(&tick, NULL);
+
+			double t = now();
+			for (size_t s = 0; s < slots.size(); ++s) {
+				int p = slots[s].current;
+				if (p != run_counters::idle) {
+					slots[s].seconds[p] += t - last;
+				}
+			}
+			last = t;
+
+			if (progress > 0 and t - last_progress >= progress) {
+				print_progress(t);
+				last_progress = t;
+			}
+		}
+	}
+
+	//counts read while the threads update them; good enough for a glance
+	void print_progress(double t) {
+		size_t bytes = 0, lines = 0, written = 0;
+		for (size_t s = 0; s < slots.size(); ++s) {
+			bytes += slots[s].bytes_read;
+			lines += slots[s].lines_read + slots[s].lines_skipped;
+			written += slots[s].records_written;
+		}
+
+		long elapsed = long(t - start);
+		std::fprintf(stderr, "random-lines: %ld:%02ld:%02ld, %.2f GB read (%.3f GB/s), %zu lines, %zu records written\n",
+			elapsed / 3600, elapsed / 60 % 60, elapsed % 60, bytes / 1e9, bytes / (t - start) / 1e9, lines, written);
+	}
+
+	std::vector<run_counters> slots;
+	double progress;
+	hardware_counters* hw;
+
+	pthread_t monitor;
+	volatile bool stopping;
+	bool running;
+
+	double start, last, last_progress;
+};
+
+} }
+
+#endif
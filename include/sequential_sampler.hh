@@ -2,37 +2,80 @@
 #define _SEQUENTIAL_SAMPLER_H_
 
 #include <cmath>
+#include <climits>
 #include <iostream>
+#include <stdexcept>
 
 #include "rng.hh"
 
 namespace math {
 
-class sequential_sampler {
+//Vitter's sequential sampling of n out of N (methods A and D), drawing from
+//any of the generators in rng.hh
+//
+//skips are worked out as N times a uniform draw, so every line can be
+//reached only while N is at most 2 to the bits a draw carries: 2^32 for the
+//Mersenne Twister and 2^53 (where doubles stop holding every integer) for
+//the others
+//
+//method D is used while N is more than ratio times n, method A after that.
+//bench/crossover times both to pick the ratio: Vitter's 13 stays with the
+//Mersenne Twister so that old seeds draw the same lines, the faster
+//generators switch at 20 where method D starts to pay off
+template<class RNG>
+struct default_crossover {
+	static const long ratio = 20;
+};
+
+template<>
+struct default_crossover<math::random> {
+	static const long ratio = 13;
+};
+
+template<class RNG>
+class basic_sequential_sampler {
 public:
-	sequential_sampler(long n, long N, math::random& rng)
-	: n(n), N(N), rng(rng) {
+	basic_sequential_sampler(long n, long N, RNG& rng, long ratio = default_crossover<RNG>::ratio)
+	: n(n), N(N), rng(rng), ratio(ratio) {
+
+		if (N > (long(1) << RNG::bits)) {
+			throw std::out_of_range("too many lines for the precision of the random number generator");
+		}
 		
 		i = 0;
-		threshold = 13 * n;
+		threshold = (ratio > 0 and n > LONG_MAX / ratio) ? LONG_MAX : ratio * n;
 				
 		vitter87_method_a_init = false;
 		vitter87_method_d_init = false;
 	
 	}
 
+	//the next k positions, as sample() returns them, into out; fewer once
+	//all n have been drawn. Positions can be worked out a block ahead of the
+	//I/O that seeks to them
+	size_t fill(long* out, size_t k) {
+		size_t filled = 0;
+		while (filled < k and n > 0) {
+			out[filled++] = sample();
+		}
+		return filled;
+	}
+
 	long sample() {
 		if (n > 1 and threshold < N) {
 			vitter87_method_d();
 		} else if (n > 1) {
 			vitter87_method_a();
 		} else if (n == 1) {
-			if(vitter87_method_a_init) {
-				s = long(std::floor(double(N) * double(rng)));
-			} else {
+			//method D leaves a uniform draw behind in v_prime
+			if(vitter87_method_d_init and not vitter87_method_a_init) {
 				s = long(std::floor(double(N) * v_prime));
+			} else {
+				s = long(std::floor(double(N) * double(rng)));
 			}
+			if (s >= N) s = N - 1;
 			i += s + 1;
+			--n;
 		} else {
 			return 0;
 		}
@@ -124,14 +167,15 @@ private:
 		--n;
 		
 		qu1 -= s;
-		threshold -= 13;
+		threshold -= ratio;
 	
 	}
 
 private:
 	long n, N, i;
 
-	math::random& rng;
+	RNG& rng;
+	long ratio;
 	
 	bool vitter87_method_a_init, vitter87_method_d_init;
 
@@ -146,6 +190,8 @@ private:
 	double x, u, v_prime, y1, y2;
 };
 
+typedef basic_sequential_sampler<math::random> sequential_sampler;
+
 }
 
 #endif
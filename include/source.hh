@@ -0,0 +1,176 @@
+#ifndef _SOURCE_HH_
+#define _SOURCE_HH_
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <algorithm>
+#include <vector>
+#include <stdexcept>
+
+#include <unistd.h>
+#include <zlib.h>
+
+/* Byte sources feeding the line scanner */
+
+namespace misc { namespace io {
+
+class source {
+public:
+	virtual ~source() {}
+
+	//up to len bytes into buf; 0 at the end of the input
+	virtual size_t read(char* buf, size_t len) = 0;
+
+	//skip ahead to a point past everything read so far but at or before the
+	//start of line target (0-based); sets the number of lines before that
+	//point, or returns false if the source cannot jump there
+	virtual bool jump(size_t target, size_t& lines) { return false; }
+};
+
+//raw bytes from a file descriptor
+class fd_source : public source {
+public:
+	fd_source(int fd)
+	: fd(fd), head(0) {
+	}
+
+	//the next len bytes without consuming them; fewer near the end
+	size_t peek(char* buf, size_t len) {
+		off_t offset = ::lseek(fd, 0, SEEK_CUR);
+
+		if (offset >= 0 and pending.empty()) {
+			size_t got = 0;
+			while (got < len) {
+				ssize_t r = ::pread(fd, buf + got, len - got, offset + got);
+				if (r > 0) {
+					got += r;
+				} else if (r == 0) {
+					break;
+				} else if (errno != EINTR) {
+					throw std::runtime_error(std::string("read failed: ") + std::strerror(errno));
+				}
+			}
+			return got;
+		}
+
+		//pipes cannot be read twice, so hold on to what was looked at
+		while (pending.size() - head < len) {
+			char tmp[4096];
+			size_t r = raw_read(tmp, sizeof(tmp));
+			if (r == 0) break;
+			pending.append(tmp, r);
+		}
+
+		size_t got = std::min(len, pending.size() - head);
+		std::memcpy(buf, pending.data() + head, got);
+		return got;
+	}
+
+	size_t read(char* buf, size_t len) {
+		if (head < pending.size()) {
+			size_t got = std::min(len, pending.size() - head);
+			std::memcpy(buf, pending.data() + head, got);
+			head += got;
+			return got;
+		}
+
+		return raw_read(buf, len);
+	}
+
+	void seek(off_t offset) {
+		if (::lseek(fd, offset, SEEK_SET) != offset) {
+			throw std::runtime_error(std::string("cannot seek input: ") + std::strerror(errno));
+		}
+		pending.clear();
+		head = 0;
+	}
+
+private:
+	size_t raw_read(char* buf, size_t len) {
+		while (1) {
+			ssize_t r = ::read(fd, buf, len);
+			if (r >= 0) {
+				return r;
+			} else if (errno != EINTR) {
+				throw std::runtime_error(std::string("read failed: ") + std::strerror(errno));
+			}
+		}
+	}
+
+	int fd;
+
+	std::string pending;
+	size_t head;
+};
+
+//gzip decompression of another source; concatenated members are read through
+class gzip_source : public source {
+public:
+	gzip_source(source& in, size_t block_size = 1 << 20)
+	: in(in), buf(block_size), done(false), in_member(false) {
+
+		std::memset(&zs, 0, sizeof(zs));
+
+		//15 window bits, +32 to take a gzip or zlib header
+		if (inflateInit2(&zs, 15 + 32) != Z_OK) {
+			throw std::runtime_error("cannot initialise zlib");
+		}
+	}
+
+	~gzip_source() {
+		inflateEnd(&zs);
+	}
+
+	size_t read(char* out, size_t len) {
+		zs.next_out = (Bytef*) out;
+		zs.avail_out = len;
+
+		while (zs.avail_out == len and not done) {
+
+			if (zs.avail_in == 0) {
+				size_t r = in.read(&buf[0], buf.size());
+				if (r == 0) {
+					if (in_member) {
+						throw std::runtime_error("truncated gzip input");
+					}
+					done = true;
+					break;
+				}
+				zs.next_in = (Bytef*) &buf[0];
+				zs.avail_in = r;
+			}
+
+			int ret = inflate(&zs, Z_NO_FLUSH);
+
+			if (ret == Z_STREAM_END) {
+				//another member may follow
+				inflateReset(&zs);
+				in_member = false;
+			} else if (ret == Z_OK or ret == Z_BUF_ERROR) {
+				in_member = true;
+			} else {
+				throw std::runtime_error("corrupt gzip input");
+			}
+		}
+
+		return len - zs.avail_out;
+	}
+
+private:
+	source& in;
+
+	std::vector<char> buf;
+	z_stream zs;
+
+	bool done, in_member;
+};
+
+//true if the bytes start a gzip member
+inline bool is_gzip(const char* p, size_t len) {
+	return len >= 3 and (unsigned char) p[0] == 0x1f and (unsigned char) p[1] == 0x8b and p[2] == 8;
+}
+
+} }
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef _WEIGHTED_SAMPLER_H_
+#define _WEIGHTED_SAMPLER_H_
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include "rng.hh"
+
+namespace math {
+
+/* Weighted reservoir sampling for streams of unknown length (Efraimidis and
+   Spirakis 2006, A-ExpJ)
+
+   Every item gets the key u^(1/w) for a uniform u and its weight w, and the
+   n largest keys are kept, which draws n items without replacement with
+   probabilities proportional to their weights. Once the reservoir is full,
+   the total weight to pass over before the next item enters is drawn up
+   front (an exponential jump), so random draws grow with the replacements
+   rather than with the items. Keys are kept as logs, on a binary heap with
+   the smallest on top. */
+
+template<class RNG>
+class basic_weighted_reservoir_sampler {
+public:
+	basic_weighted_reservoir_sampler(long n, RNG& rng)
+	: n(n), rng(rng), jump(0) {
+		heap.reserve(n);
+	}
+
+	//reservoir entry the next item, of weight w, goes into; -1 if it is
+	//passed over. Entries are numbered in the order they fill
+	long offer(double w) {
+		if (not (w > 0)) {
+			return -1;
+		}
+
+		if (long(heap.size()) < n) {
+			entry e = { std::log(open_uniform(rng)) / w, long(heap.size()) };
+			heap.push_back(e);
+			std::push_heap(heap.begin(), heap.end(), by_key());
+
+			if (long(heap.size()) == n) {
+				draw_jump();
+			}
+			return e.slot;
+		}
+
+		jump -= w;
+		if (jump > 0) {
+			return -1;
+		}
+
+		//the new key is above the smallest one, whose entry it takes
+		long slot = heap.front().slot;
+		double t = std::exp(heap.front().key * w);
+		double r = t + (1.0 - t) * open_uniform(rng);
+
+		std::pop_heap(heap.begin(), heap.end(), by_key());
+		heap.back().key = std::log(r) / w;
+		std::push_heap(heap.begin(), heap.end(), by_key());
+
+		draw_jump();
+
+		return slot;
+	}
+
+private:
+	struct entry {
+		double key;
+		long slot;
+	};
+
+	//smallest key on top
+	struct by_key {
+		bool operator()(const entry& a, const entry& b) const {
+			return a.key > b.key;
+		}
+	};
+
+	//weight to pass over before the next replacement
+	void draw_jump() {
+		jump = std::log(open_uniform(rng)) / heap.front().key;
+	}
+
+	long n;
+	RNG& rng;
+
+	std::vector<entry> heap;
+	double jump;
+};
+
+typedef basic_weighted_reservoir_sampler<math::random> weighted_reservoir_sampler;
+
+}
+
+#endif
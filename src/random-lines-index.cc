@@ -0,0 +1,64 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "options.hh"
+#include "source.hh"
+#include "bgzf.hh"
+#include "mapped_file.hh"
+#include "line_index.hh"
+
+int main(int argc, const char* argv[]) {
+
+	std::string path, output;
+
+	misc::options::parser opts("random-lines-index", "build the index random-lines uses to read only the parts of FILE it samples from", "");
+	opts.add_store_option('o', "output", "write the index to FILE (default: input FILE with .rli appended)", output, "FILE");
+	opts.add_store_argument("FILE", "plain text or BGZF compressed file to index", path);
+	opts.parse(argv, argv + argc);
+
+	if (output.empty()) {
+		output = misc::io::line_index::sidecar(path);
+	}
+
+	try {
+
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			throw std::runtime_error("cannot open " + path + ": " + std::strerror(errno));
+		}
+
+		char magic[misc::io::bgzf_header_size];
+		misc::io::fd_source raw(fd);
+		size_t got = raw.peek(magic, sizeof(magic));
+
+		if (misc::io::is_bgzf(magic, got)) {
+
+			misc::io::line_index index;
+			misc::io::bgzf_build_index(fd, index);
+			index.save(output);
+
+		} else if (misc::io::is_gzip(magic, got) or not misc::io::mapped_file::mappable(fd)) {
+
+			::close(fd);
+			std::cerr << "ERROR: Only plain text files and BGZF compressed files can be indexed!" << std::endl;
+			return 1;
+
+		} else {
+
+			misc::io::mapped_file map(fd);
+			misc::io::text_build_index(map, fd, output);
+
+		}
+
+		::close(fd);
+
+	} catch (std::exception& e) {
+
+		std::cerr << "ERROR: " << e.what() << std::endl;
+
+		return 1;
+
+	}
+
+	return 0;
+}
@@ -1,67 +1,108 @@
-#include <fstream>
-
 #include "rng.hh"
-#include "functions.hh"
-#include "sequential_sampler.hh"
 #include "options.hh"
+#include "input.hh"
+#include "record_sampling.hh"
+
+//n of the N/2 pairs, or a fraction of them if that is not negative, drawing
+//from an RNG seeded with s; a pair is a 2-line record through the same paths
+//as random-lines -k2
+template<class RNG>
+static int sample_pairs(misc::io::line_reader& lines, misc::io::line_writer& out, long n, long N, double fraction, int s) {
+
+	RNG rng(s);
+
+	//both lines of a pair come back as one span
+	misc::io::record_reader reader(lines, misc::io::record_reader::lines, 2);
+
+	if (fraction >= 0) {
+		return misc::io::sample_bernoulli(reader, out, fraction, rng);
+	}
+	return misc::io::sample_sequential(reader, out, n, N / 2, rng);
+}
 
 int main(int argc, const char* argv[]) {
 	
-	int n = 1, N = -1, s = -1;
+	long n = 1, N = -1;
+	int s = -1;
+	double fraction = -1;
+	std::string max, input, generator;
 	
 	std::ios_base::sync_with_stdio(false);
 
-	std::cin.exceptions( std::ios::badbit | std::ios::eofbit | std::ios::failbit );
-
 	misc::options::parser opts("random-lines-pairs", "output paired random lines", "");
 	opts.add_store_option('n', "num", "number of lines to return", n, "1", true);	
-	opts.add_store_option('N', "max", "Total lines in the file", N, "4294967295", true);
+	opts.add_store_option('N', "max", "Total lines in the file ('auto' counts them first)", max, "4294967295", true);
 	opts.add_store_option('s', "seed", "seed for random number generator", s); 
+	opts.add_store_option('i', "input", "read from FILE instead of STDIN (regular files are memory mapped, gzip and BGZF are decompressed)", input, "FILE");
+	opts.add_store_option('p', "fraction", "keep every pair with probability P instead of drawing a fixed number; the total lines need not be known", fraction, "P");
+	opts.add_store_option(0, "rng", "random number generator: mt (reproduces older versions), xoshiro, pcg or splitmix; 'auto' takes mt up to 2^32 pairs and xoshiro beyond", generator, "auto", true);
 	opts.parse(argv, argv + argc);
 
-	if (n >= N) {
-		std::cerr << "ERROR: The number of lines to return must be less than the total lines in the file!" << std::endl;
-		return 1;
+	if (generator.empty()) {
+		generator = "auto";
 	}
 
-	if(N%2>0) {
-		std::cerr << "ERROR: THe number of total lines must be EVEN" << std::endl;
-		return 1;
-	}
+	try {
 
-	math::random rng(s);
-	math::sequential_sampler samp(n, N/2, rng);
+		misc::io::input in(input);
+		misc::io::line_writer out;
 
-	size_t seekline, currline = 0;		
-	std::string line1, line2;
+		if (fraction != -1) {
+			if (not (fraction > 0 and fraction <= 1)) {
+				std::cerr << "ERROR: The fraction of pairs to return must be greater than 0 and at most 1!" << std::endl;
+				return 1;
+			}
+		} else {
+			//an index knows the count already
+			if (max == "auto" or (max.empty() and in.indexed())) {
+				N = in.count_lines();
+			} else if (not max.empty()) {
+				try {
+					N = boost::lexical_cast<long>(max);
+				} catch (boost::bad_lexical_cast& e) {
+					throw std::runtime_error("bad value for option: --max");
+				}
+			}
 
-	for (int i = 0; i < n; ++i) {
+			if (n >= N / 2) {
+				std::cerr << "ERROR: The number of lines to return must be less than the total lines in the file!" << std::endl;
+				return 1;
+			}
 
-		seekline = samp.sample() * 2;
+			if(N%2>0) {
+				std::cerr << "ERROR: THe number of total lines must be EVEN" << std::endl;
+				return 1;
+			}
+		}
 
-		while (currline < seekline) {
-			
-			try {
-				
-				std::getline(std::cin, line1);
-				++currline;
-				
-				std::getline(std::cin, line2);
-				++currline;
+		//the Mersenne Twister cannot reach every one of more than 2^32 pairs
+		if (generator == "auto" and N / 2 > (long(1) << math::random::bits)) {
+			generator = "xoshiro";
+		}
 
-			} catch (std::ifstream::failure e) {
+		misc::io::line_reader& reader = in.reader();
+
+		if (generator == "auto" or generator == "mt") {
+			return sample_pairs<math::random>(reader, out, n, N, fraction, s);
+		} else if (generator == "xoshiro") {
+			return sample_pairs<math::xoshiro256pp>(reader, out, n, N, fraction, s);
+#ifdef __SIZEOF_INT128__
+		} else if (generator == "pcg") {
+			return sample_pairs<math::pcg64>(reader, out, n, N, fraction, s);
+#endif
+		} else if (generator == "splitmix") {
+			return sample_pairs<math::splitmix64>(reader, out, n, N, fraction, s);
+		}
 
-				std::cerr << "ERROR: Prematurely reached the end of the file stream! -- check if the total lines is set correctly" << std::endl;
+		throw std::runtime_error("unknown random number generator: " + generator);
 
-				return 1;
+	} catch (std::exception& e) {
 
-			}
+		std::cerr << "ERROR: " << e.what() << std::endl;
 
-		}
+		return 1;
 
-		std::cout << line1 << std::endl;
-		std::cout << line2 << std::endl;
 	}
-	
+
 	return 0;
 }
@@ -1,58 +1,1095 @@
-#include <fstream>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <queue>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+
+#include <omp.h>
 
 #include "rng.hh"
 #include "functions.hh"
 #include "sequential_sampler.hh"
+#include "reservoir_sampler.hh"
+#include "bernoulli_sampler.hh"
+#include "weighted_sampler.hh"
 #include "options.hh"
+#include "string.hh"
+#include "input.hh"
+#include "record_reader.hh"
+#include "key_table.hh"
+#include "line_arena.hh"
+#include "line_writer.hh"
+#include "run_stats.hh"
+#include "record_sampling.hh"
+
+//the header lines of an input, joined by newlines
+static std::string read_header(misc::io::record_reader& reader) {
+	std::string header;
+	const char* line;
+	size_t len;
+	while (reader.header(line, len)) {
+		if (not header.empty()) {
+			header += '\n';
+		}
+		header.append(line, len);
+	}
+	return header;
+}
+
+//one output file per sample, prefix.name
+class output_files {
+public:
+	output_files(const std::string& prefix) : prefix(prefix) {}
+
+	~output_files() {
+		for (size_t i = 0; i < files.size(); ++i) {
+			delete files[i];
+		}
+	}
+
+	//the file starts with the header lines of its input, if there are any;
+	//writes are counted in stats if that is not NULL
+	void open(const std::string& name, const std::string& header, misc::io::run_counters* stats = NULL) {
+		files.reserve(files.size() + 1);
+		files.push_back(new misc::io::line_writer(prefix + "." + name));
+		files.back()->count(stats);
+
+		if (not header.empty()) {
+			files.back()->write(header.data(), header.size());
+		}
+	}
+
+	misc::io::line_writer& operator[](size_t i) { return *files[i]; }
+
+	//flushed here, so that write errors are not swallowed by the destructor
+	void flush() {
+		for (size_t i = 0; i < files.size(); ++i) {
+			files[i]->flush();
+		}
+	}
+
+private:
+	output_files(const output_files&);
+	output_files& operator=(const output_files&);
+
+	std::string prefix;
+	std::vector<misc::io::line_writer*> files;
+};
+
+//a replicate's next line; the heap keeps the lowest on top
+struct replicate_next {
+	long line;
+	size_t replicate;
+
+	bool operator<(const replicate_next& o) const {
+		return line > o.line or (line == o.line and replicate > o.replicate);
+	}
+};
+
+//k independent draws of n of N lines in one pass, replicate r written to
+//prefix.r; replicate 1 draws what a plain run with the same seed would
+template<class RNG>
+static int sample_replicates(misc::io::record_reader& reader, const std::string& prefix, const std::string& header, long n, long N, RNG& rng, int k) {
+
+	typedef math::basic_sequential_sampler<RNG> sampler;
+
+	//every replicate draws from its own substream, the seed's stream jumped
+	//once per replicate after the first
+	std::vector<RNG> streams;
+	streams.reserve(k);
+
+	RNG stream(rng);
+	for (int r = 0; r < k; ++r) {
+		streams.push_back(stream);
+		stream.jump();
+	}
+
+	//the samplers hold on to their streams, which no longer move
+	std::vector<sampler> samps;
+	samps.reserve(k);
+
+	output_files outs(prefix);
+	std::vector<long> left(k, n - 1);
+	std::priority_queue<replicate_next> heap;
+
+	for (int r = 0; r < k; ++r) {
+		outs.open(boost::lexical_cast<std::string>(r + 1), header, reader.counters());
+		samps.push_back(sampler(n, N, streams[r]));
+
+		replicate_next first = { misc::io::sample_position(samps[r], reader.counters()), size_t(r) };
+		heap.push(first);
+	}
+
+	size_t currline = 0;
+	const char* line = NULL;
+	size_t len = 0;
+
+	while (not heap.empty()) {
+
+		replicate_next top = heap.top();
+		heap.pop();
+
+		//several replicates may draw the line already read
+		if (size_t(top.line) != currline) {
+			if (not reader.skip(top.line - currline - 1) or not reader.next(line, len)) {
+				return misc::io::premature_end();
+			}
+
+			currline = top.line;
+		}
+
+		outs[top.replicate].write(line, len, reader.stable());
+
+		if (left[top.replicate] > 0) {
+			top.line = misc::io::sample_position(samps[top.replicate], reader.counters());
+			heap.push(top);
+			--left[top.replicate];
+		}
+	}
+
+	outs.flush();
+
+	return 0;
+}
+
+//nested samples of every one of sizes (distinct, largest first) in one pass;
+//the largest is drawn from the input and every smaller one from the one
+//above it, so each is a subset of the next larger and still uniform over
+//the input. Size n is written to prefix.n, and the largest holds what a
+//plain run with the same seed returns
+template<class RNG>
+static int sample_nested(misc::io::record_reader& reader, const std::string& prefix, const std::string& header, const std::vector<long>& sizes, long N, RNG& rng) {
+
+	typedef math::basic_sequential_sampler<RNG> sampler;
+
+	//depth[i] is the last of the sizes the i-th drawn line belongs to; the
+	//subsamples are drawn from their own substream before the scan
+	std::vector<unsigned char> depth(sizes[0], 0);
+	{
+		RNG stream(rng);
+		stream.jump();
+
+		std::vector<long> members, picked;
+		for (size_t j = 1; j < sizes.size(); ++j) {
+			sampler sub(sizes[j], sizes[j - 1], stream);
+
+			picked.resize(sizes[j]);
+			for (long i = 0; i < sizes[j]; ++i) {
+				long k = sub.sample() - 1;
+				picked[i] = (j == 1) ? k : members[k];
+				depth[picked[i]] = j;
+			}
+			members.swap(picked);
+		}
+	}
+
+	output_files outs(prefix);
+	for (size_t j = 0; j < sizes.size(); ++j) {
+		outs.open(boost::lexical_cast<std::string>(sizes[j]), header, reader.counters());
+	}
+
+	sampler samp(sizes[0], N, rng);
+
+	size_t seekline, currline = 0;
+	const char* line;
+	size_t len;
+
+	for (long i = 0; i < sizes[0]; ++i) {
+
+		seekline = misc::io::sample_position(samp, reader.counters());
+
+		if (not reader.skip(seekline - currline - 1) or not reader.next(line, len)) {
+			return misc::io::premature_end();
+		}
+
+		currline = seekline;
+
+		for (size_t j = 0; j <= depth[i]; ++j) {
+			outs[j].write(line, len, reader.stable());
+		}
+	}
+
+	outs.flush();
+
+	return 0;
+}
+
+//gaps between the records taken, for n of N
+template<class RNG>
+class sequential_gaps {
+public:
+	sequential_gaps(long n, long N, RNG& rng) : samp(n, N, rng), last(0) {}
+
+	size_t draw(long* out, size_t k) {
+		size_t count = samp.fill(out, k);
+		for (size_t i = 0; i < count; ++i) {
+			long pos = out[i];
+			out[i] = pos - last - 1;
+			last = pos;
+		}
+		return count;
+	}
+
+	//taking fewer than drawn means the input is short
+	static const bool to_end = false;
+
+private:
+	math::basic_sequential_sampler<RNG> samp;
+	long last;
+};
+
+//gaps between the records taken, each with probability p
+template<class RNG>
+class bernoulli_gaps {
+public:
+	bernoulli_gaps(double p, RNG& rng) : samp(p, rng) {}
+
+	size_t draw(long* out, size_t k) {
+		for (size_t i = 0; i < k; ++i) {
+			out[i] = samp.skip();
+		}
+		return k;
+	}
+
+	//gaps are drawn until the input runs out
+	static const bool to_end = true;
+
+private:
+	math::basic_bernoulli_sampler<RNG> samp;
+};
+
+//gaps drawn at a time for both mates
+static const size_t mate_batch = 1 << 16;
+
+//the records after the given gaps, written out; how many there were
+static size_t take_gaps(misc::io::record_reader& reader, misc::io::line_writer& out, const long* gaps, size_t count) {
+	misc::io::run_phase phase(reader.counters(), misc::io::run_counters::scan);
+
+	const char* rec;
+	size_t len;
+
+	for (size_t i = 0; i < count; ++i) {
+		if (not reader.skip(gaps[i]) or not reader.next(rec, len)) {
+			return i;
+		}
+		out.write(rec, len, reader.stable());
+	}
+	return count;
+}
+
+//the same records of two inputs read in lockstep (the mates of paired
+//reads), written to prefix.1 and prefix.2; the inputs are read and written
+//on a thread each, a batch of gaps at a time
+template<class Gaps>
+static int sample_mates(misc::io::record_reader& first, misc::io::record_reader& second, const std::string& prefix, Gaps& gaps) {
+
+	misc::io::record_reader* readers[2] = { &first, &second };
+
+	output_files outs(prefix);
+	for (int m = 0; m < 2; ++m) {
+		outs.open(boost::lexical_cast<std::string>(m + 1), read_header(*readers[m]), readers[m]->counters());
+	}
+
+	std::vector<long> batch(mate_batch);
+	size_t count;
+	bool more = true;
+
+	//each side inflates BGZF input on half the threads, nested in its own
+	int half = std::max(omp_get_max_threads() / 2, 1);
+	omp_set_max_active_levels(std::max(omp_get_max_active_levels(), 2));
+
+	while (1) {
+		count = 0;
+		if (more) {
+			misc::io::run_phase phase(first.counters(), misc::io::run_counters::sample);
+			count = gaps.draw(&batch[0], batch.size());
+		}
+
+		//no more gaps: read both to the end, to find out if they end together
+		size_t taken[2];
+		std::string error[2];
+
+		#pragma omp parallel for num_threads(2)
+		for (int m = 0; m < 2; ++m) {
+			omp_set_num_threads(half);
+			try {
+				if (count > 0) {
+					taken[m] = take_gaps(*readers[m], outs[m], &batch[0], count);
+				} else {
+					misc::io::run_phase phase(readers[m]->counters(), misc::io::run_counters::scan);
+					readers[m]->skip_rest();
+					taken[m] = 0;
+				}
+			} catch (std::exception& e) {
+				error[m] = e.what();
+			}
+		}
+
+		for (int m = 0; m < 2; ++m) {
+			if (not error[m].empty()) {
+				throw std::runtime_error(error[m]);
+			}
+		}
+
+		if (count == 0) {
+			break;
+		}
+
+		if (taken[0] != taken[1]) {
+			std::cerr << "ERROR: The paired inputs do not have the same number of records!" << std::endl;
+			return 1;
+		}
+
+		if (taken[0] < count) {
+			if (not Gaps::to_end) {
+				return misc::io::premature_end();
+			}
+			more = false;
+		}
+	}
+
+	//both at the end now, however little of them was sampled
+	if (first.tell() != second.tell()) {
+		std::cerr << "ERROR: The paired inputs do not have the same number of records!" << std::endl;
+		return 1;
+	}
+
+	outs.flush();
+
+	return 0;
+}
+
+//a line aligned piece of a mapped input and what is drawn from it
+struct chunk {
+	const char* begin;
+	const char* end;
+
+	size_t lines;
+
+	//drawn lines, counted from 1 at the start of the chunk
+	std::vector<size_t> positions;
+
+	std::vector<std::pair<const char*, size_t> > sampled;
+};
+
+//chunks are about this size whatever the number of threads
+static const size_t parallel_chunk = 1 << 24;
+
+//exactly n of N lines of a mapped input, read on several threads. The lines
+//are those the single threaded path draws for the same seed and total: one
+//sequential sampler picks them all, and the threads only skip and read.
+//Every thread counts into its own counters of stats, if that is not NULL
+template<class RNG>
+static int sample_parallel(const misc::io::mapped_file& map, misc::io::line_writer& out, long n, long N, RNG& rng, int threads, misc::io::run_stats* stats) {
+
+	std::vector<const char*> bounds = misc::io::split_lines(map.begin(), map.end(), map.size() / parallel_chunk + 1);
+	std::vector<chunk> chunks(bounds.size() - 1);
+
+	#pragma omp parallel for schedule(dynamic) num_threads(threads)
+	for (long c = 0; c < long(chunks.size()); ++c) {
+		misc::io::run_counters* counters = (stats != NULL) ? stats->thread(omp_get_thread_num()) : NULL;
+		misc::io::run_phase phase(counters, misc::io::run_counters::scan);
+
+		//bytes are counted once, by the readers below
+		chunks[c].begin = bounds[c];
+		chunks[c].end = bounds[c + 1];
+		chunks[c].lines = misc::io::count_lines(bounds[c], bounds[c + 1]);
+	}
+
+	size_t total = 0;
+	for (size_t c = 0; c < chunks.size(); ++c) {
+		total += chunks[c].lines;
+	}
+
+	if (size_t(N) != total) {
+		std::cerr << "ERROR: The total lines is set incorrectly! -- the input has " << total << " lines" << std::endl;
+		return 1;
+	}
+
+	if (size_t(n) >= total) {
+		std::cerr << "ERROR: The number of lines to return must be less than the total lines in the file!" << std::endl;
+		return 1;
+	}
+
+	//the positions come out in order, so each falls in the chunk of the one
+	//before or a later one
+	math::basic_sequential_sampler<RNG> samp(n, total, rng);
+	misc::io::run_counters* main_counters = (stats != NULL) ? stats->thread(0) : NULL;
+
+	std::vector<long> positions(misc::io::sample_batch);
+	size_t c = 0, first = 0, count;
+	while ((count = misc::io::sample_positions(samp, positions, main_counters)) > 0) {
+		for (size_t i = 0; i < count; ++i) {
+			size_t line = positions[i] - 1;
+			while (line >= first + chunks[c].lines) {
+				first += chunks[c++].lines;
+			}
+			chunks[c].positions.push_back(line - first + 1);
+		}
+	}
+
+	bool premature = false;
+
+	#pragma omp parallel for schedule(dynamic) num_threads(threads)
+	for (long c = 0; c < long(chunks.size()); ++c) {
+		chunk& ch = chunks[c];
+		if (ch.positions.empty()) {
+			continue;
+		}
+
+		misc::io::run_counters* counters = (stats != NULL) ? stats->thread(omp_get_thread_num()) : NULL;
+		misc::io::run_phase phase(counters, misc::io::run_counters::scan);
+
+		misc::io::line_reader reader(map, ch.begin, ch.end);
+		reader.count(counters);
+
+		size_t seekline, currline = 0;
+		const char* line;
+		size_t len;
+
+		ch.sampled.reserve(ch.positions.size());
+
+		for (size_t i = 0; i < ch.positions.size(); ++i) {
+
+			seekline = ch.positions[i];
+
+			if (not reader.skip(seekline - currline - 1) or not reader.next(line, len)) {
+				#pragma omp atomic write
+				premature = true;
+				break;
+			}
+
+			currline = seekline;
+
+			ch.sampled.push_back(std::make_pair(line, len));
+		}
+	}
+
+	if (premature) {
+		return misc::io::premature_end();
+	}
+
+	//spans point into the mapping; emit them in file order
+	for (c = 0; c < chunks.size(); ++c) {
+		for (size_t i = 0; i < chunks[c].sampled.size(); ++i) {
+			out.write(chunks[c].sampled[i].first, chunks[c].sampled[i].second, true);
+		}
+	}
+
+	out.flush();
+
+	return 0;
+}
+
+//orders reservoir slots by the input line they hold
+struct by_line {
+	by_line(const std::vector<size_t>& lines) : lines(lines) {}
+
+	bool operator()(size_t a, size_t b) const {
+		return lines[a] < lines[b];
+	}
+
+	const std::vector<size_t>& lines;
+};
+
+//the arena's slots in the given order, or in input order if ordered (slot j
+//holds input line lines[j])
+static int write_arena(misc::io::line_writer& out, const misc::io::line_arena& arena, std::vector<size_t>& order, const std::vector<size_t>& lines, bool ordered) {
+	if (ordered) {
+		std::sort(order.begin(), order.end(), by_line(lines));
+	}
+
+	//the arena is done changing, its lines can be written from where they are
+	for (size_t j = 0; j < order.size(); ++j) {
+		out.write(arena.data(order[j]), arena.size(order[j]), true);
+	}
+
+	out.flush();
+
+	return 0;
+}
+
+//the first filled slots, in slot order unless ordered
+static int write_arena(misc::io::line_writer& out, const misc::io::line_arena& arena, size_t filled, const std::vector<size_t>& lines, bool ordered) {
+	std::vector<size_t> order(filled);
+	for (size_t j = 0; j < filled; ++j) {
+		order[j] = j;
+	}
+	return write_arena(out, arena, order, lines, ordered);
+}
+
+//n lines from a stream of unknown length
+template<class RNG>
+static int sample_reservoir(misc::io::record_reader& reader, misc::io::line_writer& out, long n, RNG& rng, bool ordered) {
+
+	misc::io::line_arena arena(n);
+	std::vector<size_t> lines(n);
+
+	const char* line;
+	size_t len, currline = 0;
+
+	//fill
+	while (currline < size_t(n) and reader.next(line, len)) {
+		arena.assign(currline, line, len);
+		lines[currline] = currline;
+		++currline;
+	}
+
+	size_t filled = currline;
+
+	//replace
+	if (filled == size_t(n)) {
+
+		math::basic_reservoir_sampler<RNG> samp(n, rng);
+
+		while (1) {
+
+			long skip = misc::io::sample_skip(samp, reader.counters());
+
+			if (not reader.skip(skip) or not reader.next(line, len)) {
+				break;
+			}
+
+			currline += skip + 1;
+
+			long j = samp.slot();
+			arena.assign(j, line, len);
+			lines[j] = currline - 1;
+		}
+	}
+
+	return write_arena(out, arena, filled, lines, ordered);
+}
+
+//tab separated field number column (0-based) of the first line of
+//[p, p + len), as [b, e); false if the line has fewer fields
+static bool find_field(const char* p, size_t len, size_t column, const char*& b, const char*& e) {
+	e = p + len;
+
+	//only the first line of a record counts
+	const char* nl = (const char*) std::memchr(p, '\n', len);
+	if (nl != NULL) {
+		e = nl;
+	}
+
+	for (size_t c = 0; c < column; ++c) {
+		const char* t = (const char*) std::memchr(p, '\t', e - p);
+		if (t == NULL) {
+			return false;
+		}
+		p = t + 1;
+	}
+	const char* t = (const char*) std::memchr(p, '\t', e - p);
+	if (t != NULL) {
+		e = t;
+	}
+	b = p;
+	return true;
+}
+
+//the number in tab separated field column (0-based) of [p, p + len); false
+//if there is none
+static bool parse_weight(const char* line, size_t len, size_t column, double& w) {
+	const char* p;
+	const char* e;
+	if (not find_field(line, len, column, p, e)) {
+		return false;
+	}
+
+	size_t n = e - p;
+
+	//counts are the common case, and much quicker to read by hand
+	if (n > 0 and n < 16) {
+		unsigned long v = 0;
+		size_t i = 0;
+		while (i < n and p[i] >= '0' and p[i] <= '9') {
+			v = 10 * v + (p[i++] - '0');
+		}
+		if (i == n) {
+			w = double(v);
+			return true;
+		}
+	}
+
+	//strtod needs the field to end
+	char field[64];
+	if (n == 0 or n >= sizeof(field)) {
+		return false;
+	}
+	std::memcpy(field, p, n);
+	field[n] = '\0';
+
+	char* end;
+	w = std::strtod(field, &end);
+	return end == field + n and w >= 0 and w < HUGE_VAL;
+}
+
+//n lines drawn with probabilities proportional to the weights in column
+//(0-based), from a stream of unknown length
+template<class RNG>
+static int sample_weighted(misc::io::record_reader& reader, misc::io::line_writer& out, long n, size_t column, RNG& rng, bool ordered) {
+
+	math::basic_weighted_reservoir_sampler<RNG> samp(n, rng);
+
+	misc::io::line_arena arena;
+	std::vector<size_t> lines;
+
+	const char* line;
+	size_t len, currline = 0;
+	double w;
+
+	while (reader.next(line, len)) {
+		++currline;
+
+		if (not parse_weight(line, len, column, w)) {
+			std::cerr << "ERROR: No weight in column " << column + 1 << " of record " << currline << "!" << std::endl;
+			return 1;
+		}
+
+		long j;
+		{
+			misc::io::run_phase phase(reader.counters(), misc::io::run_counters::sample);
+			j = samp.offer(w);
+		}
+		if (j < 0) {
+			continue;
+		}
+
+		if (size_t(j) == arena.slots()) {
+			arena.push(line, len);
+			lines.push_back(currline - 1);
+		} else {
+			arena.assign(j, line, len);
+			lines[j] = currline - 1;
+		}
+	}
+
+	return write_arena(out, arena, arena.slots(), lines, ordered);
+}
+
+//a stratum's reservoir: its lines in the arena, and once it is full the
+//sampler that replaces them and the lines to pass over until then
+struct stratum {
+	std::vector<size_t> slots;
+	long sampler, skip;
+};
+
+//n lines of every distinct value in column (0-based), in one pass;
+//strata come out in the order they first appear, or everything in input
+//order
+template<class RNG>
+static int sample_strata(misc::io::record_reader& reader, misc::io::line_writer& out, long n, size_t column, RNG& rng, bool ordered) {
+
+	misc::io::key_table keys;
+	std::vector<stratum> strata;
+	std::vector<math::basic_reservoir_sampler<RNG> > samps;
+
+	misc::io::line_arena arena;
+	std::vector<size_t> lines;
+
+	const char* line;
+	const char* b;
+	const char* e;
+	size_t len, currline = 0;
+
+	while (reader.next(line, len)) {
+		++currline;
+
+		if (not find_field(line, len, column, b, e)) {
+			std::cerr << "ERROR: No column " << column + 1 << " in record " << currline << "!" << std::endl;
+			return 1;
+		}
+		size_t k = keys.find_or_insert(b, e - b);
+		if (k == strata.size()) {
+			stratum st = { std::vector<size_t>(), -1, 0 };
+			strata.push_back(st);
+		}
+		stratum& st = strata[k];
+
+		//fill
+		if (long(st.slots.size()) < n) {
+			st.slots.push_back(arena.push(line, len));
+			lines.push_back(currline - 1);
+
+			if (long(st.slots.size()) == n) {
+				st.sampler = samps.size();
+				samps.push_back(math::basic_reservoir_sampler<RNG>(n, rng));
+				st.skip = misc::io::sample_skip(samps.back(), reader.counters());
+			}
+			continue;
+		}
+
+		//replace
+		if (st.skip > 0) {
+			--st.skip;
+			continue;
+		}
+
+		size_t j = st.slots[samps[st.sampler].slot()];
+		arena.assign(j, line, len);
+		lines[j] = currline - 1;
+
+		st.skip = misc::io::sample_skip(samps[st.sampler], reader.counters());
+	}
+
+	std::vector<size_t> order;
+	order.reserve(arena.slots());
+	for (size_t k = 0; k < strata.size(); ++k) {
+		order.insert(order.end(), strata[k].slots.begin(), strata[k].slots.end());
+	}
+	return write_arena(out, arena, order, lines, ordered);
+}
+
+//what to draw, from the command line
+struct settings {
+	long n, N;
+	int threads;
+	bool reservoir, ordered;
+
+	//negative unless sampling by fraction
+	double fraction;
+
+	//more than one writes each replicate to output.1, output.2, ...
+	int replicates;
+	std::string output;
+
+	//nested samples of these sizes, largest first, if any
+	std::vector<long> sizes;
+
+	//what a record is (see record_reader), with k lines to a record for
+	//"lines" or lines grouped by column group if that is not 0; n and N
+	//count records
+	std::string format;
+	size_t k, group;
+
+	//the mates of the input's records, if not empty
+	std::string mate;
+
+	//draw by the weights in this column (1-based) if it is not 0
+	size_t weight;
+
+	//n of every value in this column (1-based) if it is not 0
+	size_t strata;
+
+	//counters for every thread, NULL if not asked for
+	misc::io::run_stats* stats;
+};
+
+//one of the above, drawing from an RNG seeded with s
+template<class RNG>
+static int sample(misc::io::input& in, misc::io::line_writer& out, const settings& opt, int s) {
+
+	RNG rng(s);
+
+	//the main thread counts into the first counters, a mate reader into the
+	//second
+	misc::io::run_counters* counters = (opt.stats != NULL) ? opt.stats->thread(0) : NULL;
+	misc::io::run_phase phase(counters, misc::io::run_counters::scan);
+	out.count(counters);
+
+	//the parallel path splits a mapping by lines itself
+	if (opt.threads > 1) {
+		return sample_parallel(*in.mapping(), out, opt.n, opt.N, rng, opt.threads, opt.stats);
+	}
+
+	in.reader().count(counters);
+	misc::io::record_reader reader = misc::io::record_reader::parse(in.reader(), opt.format, opt.k, opt.group);
+
+	if (not opt.mate.empty()) {
+		misc::io::input mate_in(opt.mate);
+		mate_in.reader().count((opt.stats != NULL) ? opt.stats->thread(1) : NULL);
+		misc::io::record_reader mate = misc::io::record_reader::parse(mate_in.reader(), opt.format, opt.k, opt.group);
+
+		if (opt.fraction >= 0) {
+			bernoulli_gaps<RNG> gaps(opt.fraction, rng);
+			return sample_mates(reader, mate, opt.output, gaps);
+		}
+
+		sequential_gaps<RNG> gaps(opt.n, opt.N, rng);
+		return sample_mates(reader, mate, opt.output, gaps);
+	}
+
+	//header lines go ahead of every sample
+	std::string header = read_header(reader);
+
+	if (opt.sizes.empty() and opt.replicates == 1 and not header.empty()) {
+		out.write(header.data(), header.size());
+	}
+
+	if (opt.fraction >= 0) {
+		return misc::io::sample_bernoulli(reader, out, opt.fraction, rng);
+	}
+
+	if (opt.strata > 0) {
+		return sample_strata(reader, out, opt.n, opt.strata - 1, rng, opt.ordered);
+	}
+
+	if (opt.weight > 0) {
+		return sample_weighted(reader, out, opt.n, opt.weight - 1, rng, opt.ordered);
+	}
+
+	if (opt.reservoir) {
+		return sample_reservoir(reader, out, opt.n, rng, opt.ordered);
+	}
+
+	if (not opt.sizes.empty()) {
+		return sample_nested(reader, opt.output, header, opt.sizes, opt.N, rng);
+	}
+
+	if (opt.replicates > 1) {
+		return sample_replicates(reader, opt.output, header, opt.n, opt.N, rng, opt.replicates);
+	}
+
+	return misc::io::sample_sequential(reader, out, opt.n, opt.N, rng);
+}
+
+//records of the given format in the file at path, in a pass of its own
+static long count_records(const std::string& path, const std::string& format, size_t group) {
+
+	if (path.empty() or path == "-") {
+		throw std::runtime_error("counting " + format + " records needs --input FILE");
+	}
+
+	misc::io::input in(path);
+	misc::io::record_reader reader = misc::io::record_reader::parse(in.reader(), format, 1, group);
+
+	const char* rec;
+	size_t len;
+	while (reader.header(rec, len)) {
+	}
+
+	long count = 0;
+	while (reader.next(rec, len)) {
+		++count;
+	}
+
+	return count;
+}
 
 int main(int argc, const char* argv[]) {
-	
-	int n = 1, N = -1, s = -1;
-	
-	std::ios_base::sync_with_stdio(false);
 
-	std::cin.exceptions( std::ios::badbit | std::ios::eofbit | std::ios::failbit );
+	long n = 1, N = -1;
+	int s = -1, threads = 1, replicates = 1;
+	size_t k = 1, group = 0, weight = 0, strata = 0;
+	double fraction = -1, progress = 0;
+	std::string max, input, mate, output, sizes, format, generator;
+	bool reservoir = false, ordered = false, show_stats = false;
+
+	std::ios_base::sync_with_stdio(false);
 
 	misc::options::parser opts("random-lines", "output random lines", "");
-	opts.add_store_option('n', "num", "number of lines to return", n, "1", true);	
-	opts.add_store_option('N', "max", "total lines in the file", N, "4294967295", true);
-	opts.add_store_option('s', "seed", "seed for random number generator", s); 
+	opts.add_store_option('n', "num", "number of lines (records) to return", n, "1", true);
+	opts.add_store_option('N', "max", "total lines (records) in the file ('auto' counts them first)", max, "4294967295", true);
+	opts.add_store_option('s', "seed", "seed for random number generator", s);
+	opts.add_store_option('i', "input", "read from FILE instead of STDIN (regular files are memory mapped, gzip and BGZF are decompressed)", input, "FILE");
+	opts.add_store_option('t', "threads", "number of threads to sample a memory mapped input with", threads, "1", true);
+	opts.add_bool_option('r', "reservoir", "single pass reservoir sampling; the total lines need not be known", reservoir, "", false);
+	opts.add_bool_option(0, "ordered", "with --reservoir, --weight-col or --strata, output lines in input order", ordered, "", false);
+	opts.add_store_option('w', "weight-col", "draw lines with probabilities proportional to the number in tab separated COLUMN, in one pass; the total lines need not be known", weight, "COLUMN");
+	opts.add_store_option(0, "strata", "draw -n lines of every distinct value in tab separated COLUMN, in one pass; the total lines need not be known", strata, "COLUMN");
+	opts.add_store_option('p', "fraction", "keep every line with probability P instead of drawing a fixed number; the total lines need not be known", fraction, "P");
+	opts.add_store_option(0, "replicates", "draw K independent samples in the same pass, each written to its own file (see --output)", replicates, "1", true);
+	opts.add_store_option(0, "sizes", "draw nested samples of every one of these comma separated sizes in the same pass, each a subset of the next larger (see --output)", sizes, "LIST");
+	opts.add_store_option(0, "mate", "read FILE in step with the input, taking the same records from both (R1 and R2 of paired reads; see --output)", mate, "FILE");
+	opts.add_store_option('o', "output", "with --replicates, write replicate K to PREFIX.K; with --sizes, the sample of size S to PREFIX.S; with --mate, the input's records to PREFIX.1 and the mates to PREFIX.2", output, "PREFIX");
+	opts.add_store_option(0, "format", "what to sample: lines, fastq (4 line records), fasta (from one '>' line to the next) or sam (the '@' header is passed through, then one alignment per line)", format, "lines", true);
+	opts.add_store_option('k', "record-lines", "with --format=lines, lines to a record", k, "1", true);
+	opts.add_store_option('g', "group-by", "sample groups of consecutive lines with the same value in tab separated COLUMN (1 is QNAME for SAM) instead of single lines", group, "COLUMN");
+	opts.add_store_option(0, "rng", "random number generator: mt (reproduces older versions), xoshiro, pcg or splitmix; 'auto' takes mt up to 2^32 lines and xoshiro beyond", generator, "auto", true);
+	opts.add_bool_option(0, "stats", "at the end, print to STDERR the bytes and lines read, lines skipped, records written, the time spent reading, scanning, sampling and writing, and hardware counters where the kernel allows", show_stats, "", false);
+	opts.add_store_option(0, "progress", "print a progress line to STDERR every SECONDS", progress, "SECONDS");
 	opts.parse(argv, argv + argc);
 
-	if (n >= N) {
-		std::cerr << "ERROR: The number of lines to return must be less than the total lines in the file!" << std::endl;
-		return 1;
+	if (generator.empty()) {
+		generator = "auto";
+	}
+	if (format.empty()) {
+		format = "lines";
 	}
-	
-	math::random rng(s);
-	math::sequential_sampler samp(n, N, rng);
 
-	size_t seekline, currline = 0;		
-	std::string line;
+	//outlives the readers and writers that count into it
+	misc::io::run_stats* stats = NULL;
+	int status = 0;
+
+	try {
 
-	for (int i = 0; i < n; ++i) {
+		if (show_stats or progress > 0) {
+			stats = new misc::io::run_stats(std::max(threads, 2), progress, show_stats);
+		}
 
-		seekline = samp.sample();
+		misc::io::input in(input);
+		misc::io::line_writer out;
 
-		while (currline < seekline) {
-			
+		std::vector<long> nested;
+		if (not sizes.empty()) {
 			try {
-				
-				std::getline(std::cin, line);
-				++currline;
+				misc::string::split(sizes, std::back_inserter(nested), ",");
+			} catch (boost::bad_lexical_cast& e) {
+				throw std::runtime_error("bad value for option: --sizes");
+			}
 
-			} catch (std::ifstream::failure e) {
+			std::sort(nested.begin(), nested.end(), std::greater<long>());
+			nested.erase(std::unique(nested.begin(), nested.end()), nested.end());
 
-				std::cerr << "ERROR: Prematurely reached the end of the file stream! -- check if the total lines is set correctly" << std::endl;
+			if (nested.empty() or nested.back() < 1) {
+				std::cerr << "ERROR: The sample sizes must be at least one!" << std::endl;
+				return 1;
+			}
+			if (nested.size() > 256) {
+				std::cerr << "ERROR: At most 256 sample sizes can be drawn at once!" << std::endl;
+				return 1;
+			}
+
+			//checked against the total lines like any other sample size
+			n = nested[0];
+		}
 
+		if (k < 1) {
+			std::cerr << "ERROR: A record must be at least one line!" << std::endl;
+			return 1;
+		}
+		if (k > 1 and format != "lines") {
+			std::cerr << "ERROR: --record-lines only applies to --format=lines!" << std::endl;
+			return 1;
+		}
+
+		//the parallel path splits by single lines
+		if (format != "lines" or k > 1 or group > 0) {
+			threads = 1;
+		}
+
+		if (replicates < 1) {
+			std::cerr << "ERROR: The number of replicates must be at least one!" << std::endl;
+			return 1;
+		}
+		if (replicates > 1 and n < 1) {
+			std::cerr << "ERROR: The number of lines to return must be at least one!" << std::endl;
+			return 1;
+		}
+		if (not mate.empty()) {
+			if (reservoir or replicates > 1 or not nested.empty()) {
+				std::cerr << "ERROR: --mate cannot be combined with --reservoir, --replicates or --sizes!" << std::endl;
+				return 1;
+			}
+			if (mate == "-" and (input.empty() or input == "-")) {
+				std::cerr << "ERROR: The input and its mates cannot both be read from STDIN!" << std::endl;
 				return 1;
+			}
+		}
 
+		if ((replicates > 1 or not nested.empty()) and (fraction != -1 or reservoir or (replicates > 1 and not nested.empty()))) {
+			std::cerr << "ERROR: --replicates and --sizes cannot be combined with each other, --fraction or --reservoir!" << std::endl;
+			return 1;
+		}
+		if (replicates > 1 or not nested.empty() or not mate.empty()) {
+			if (output.empty()) {
+				std::cerr << "ERROR: --replicates, --sizes and --mate need an --output prefix to name the samples by!" << std::endl;
+				return 1;
 			}
 
+			//the samples share one scan
+			threads = 1;
+		}
+
+		if ((weight > 0 or strata > 0) and (reservoir or fraction != -1 or replicates > 1 or not nested.empty() or not mate.empty() or (weight > 0 and strata > 0))) {
+			std::cerr << "ERROR: --weight-col and --strata cannot be combined with each other, --reservoir, --fraction, --replicates, --sizes or --mate!" << std::endl;
+			return 1;
 		}
 
-		std::cout << line << std::endl;
+		//only a fixed number of lines of a known total is drawn on several threads
+		if (fraction != -1 or reservoir or weight > 0 or strata > 0) {
+			threads = 1;
+		}
+
+		if (fraction != -1) {
+			if (not (fraction > 0 and fraction <= 1)) {
+				std::cerr << "ERROR: The fraction of lines to return must be greater than 0 and at most 1!" << std::endl;
+				return 1;
+			}
+			if (reservoir) {
+				std::cerr << "ERROR: --fraction and --reservoir cannot be combined!" << std::endl;
+				return 1;
+			}
+		} else if (reservoir or weight > 0 or strata > 0) {
+			if (n < 1) {
+				std::cerr << "ERROR: The number of lines to return must be at least one!" << std::endl;
+				return 1;
+			}
+		} else {
+			//an indexed input is only read where sampled, there is nothing to split
+			if (threads > 1 and (in.mapping() == NULL or in.indexed())) {
+				threads = 1;
+			}
+
+			//an index knows the count already; the parallel path counts it
+			//first, so that the generator is picked by the same total as
+			//with -N
+			if (max == "auto" or (max.empty() and (in.indexed() or threads > 1))) {
+				if (format == "fasta" or format == "sam" or group > 0) {
+					N = count_records(input, format, group);
+				} else {
+					long per = (format == "fastq") ? 4 : long(k);
+
+					N = in.count_lines();
+					if (N % per != 0) {
+						std::cerr << "ERROR: The total lines must be a multiple of the lines to a record!" << std::endl;
+						return 1;
+					}
+					N /= per;
+				}
+			} else if (not max.empty()) {
+				try {
+					N = boost::lexical_cast<long>(max);
+				} catch (boost::bad_lexical_cast& e) {
+					throw std::runtime_error("bad value for option: --max");
+				}
+			}
+
+			if (n >= N) {
+				std::cerr << "ERROR: The number of lines to return must be less than the total lines in the file!" << std::endl;
+				return 1;
+			}
+
+			//the Mersenne Twister cannot reach every one of more than 2^32
+			//lines
+			if (generator == "auto" and N > (long(1) << math::random::bits)) {
+				generator = "xoshiro";
+			}
+		}
+
+		settings opt = { n, N, threads, reservoir, ordered, fraction, replicates, output, nested, format, k, group, mate, weight, strata, stats };
+
+		if (generator == "auto" or generator == "mt") {
+			status = sample<math::random>(in, out, opt, s);
+		} else if (generator == "xoshiro") {
+			status = sample<math::xoshiro256pp>(in, out, opt, s);
+#ifdef __SIZEOF_INT128__
+		} else if (generator == "pcg") {
+			status = sample<math::pcg64>(in, out, opt, s);
+#endif
+		} else if (generator == "splitmix") {
+			status = sample<math::splitmix64>(in, out, opt, s);
+		} else {
+			throw std::runtime_error("unknown random number generator: " + generator);
+		}
+
+	} catch (std::exception& e) {
+
+		std::cerr << "ERROR: " << e.what() << std::endl;
+
+		status = 1;
+
 	}
-	
-	return 0;
+
+	//the output is flushed and closed by now
+	if (stats != NULL) {
+		if (show_stats) {
+			stats->report();
+		}
+		delete stats;
+	}
+
+	return status;
 }
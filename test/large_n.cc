@@ -0,0 +1,108 @@
+#include <cstdio>
+#include <vector>
+#include <stdexcept>
+
+#include "rng.hh"
+#include "sequential_sampler.hh"
+
+/* Line counts past 32 bits: n of N = 10^10 (and up to 2^53) must come out
+   strictly increasing within 1..N, spread over the whole range rather than
+   wrapped below 2^31 or 2^32, the same from fill() as from sample(), and a
+   generator must refuse an N its draws cannot reach. Run by make check; the
+   exit status is 1 if anything failed. */
+
+static int failed = 0;
+
+static void check(bool ok, const char* rng, const char* what) {
+	std::printf("%-9s %-52s %s\n", rng, what, ok ? "ok" : "FAIL");
+	if (not ok) {
+		++failed;
+	}
+}
+
+//trials draws of n of N; positions in order and in range, their mean near
+//N / 2 and some of them past 2^32
+template<class RNG>
+static bool spread(long n, long N, int trials) {
+	RNG rng(1);
+	double sum = 0;
+	long count = 0;
+	bool high = false;
+
+	for (int t = 0; t < trials; ++t) {
+		math::basic_sequential_sampler<RNG> samp(n, N, rng);
+
+		long last = 0;
+		for (long i = 0; i < n; ++i) {
+			long p = samp.sample();
+			if (p <= last or p > N) {
+				return false;
+			}
+			last = p;
+			sum += double(p) / N;
+			++count;
+			high = high or p > (long(1) << 32);
+		}
+	}
+
+	//the mean of count uniform draws is off by 0.29 / sqrt(count) typically
+	double mean = sum / count;
+	return high and mean > 0.49 and mean < 0.51;
+}
+
+template<class RNG>
+static bool same_fill(long n, long N) {
+	RNG a(7), b(7);
+	math::basic_sequential_sampler<RNG> one(n, N, a), batch(n, N, b);
+
+	std::vector<long> positions(n);
+	if (batch.fill(&positions[0], n) != size_t(n)) {
+		return false;
+	}
+	for (long i = 0; i < n; ++i) {
+		if (one.sample() != positions[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+template<class RNG>
+static bool refuses(long N) {
+	RNG rng(1);
+	try {
+		math::basic_sequential_sampler<RNG> samp(1, N, rng);
+	} catch (std::out_of_range& e) {
+		return true;
+	}
+	return false;
+}
+
+template<class RNG>
+static void check_rng(const char* name) {
+	const long N = 10000000000L;
+	const long top = long(1) << RNG::bits;
+
+	check(spread<RNG>(1000, N, 200), name, "1000 of 10^10, in order and spread over 1..N");
+	check(spread<RNG>(1, N, 20000), name, "1 of 10^10, spread over 1..N");
+	check(spread<RNG>(10, top, 2000), name, "10 of 2^53, spread over 1..N");
+	check(same_fill<RNG>(100000, N), name, "fill() draws what sample() does at 10^10");
+	check(refuses<RNG>(top + 1), name, "refuses 2^53 + 1 lines");
+}
+
+int main() {
+
+	check_rng<math::xoshiro256pp>("xoshiro");
+#ifdef __SIZEOF_INT128__
+	check_rng<math::pcg64>("pcg");
+#endif
+	check_rng<math::splitmix64>("splitmix");
+
+	check(refuses<math::random>((long(1) << 32) + 1), "mt", "refuses 2^32 + 1 lines");
+
+	if (failed > 0) {
+		std::printf("\n%d check(s) failed\n", failed);
+		return 1;
+	}
+	return 0;
+}